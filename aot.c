@@ -0,0 +1,627 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the ahead-of-time compiler from the dictionary
+// to C.
+//
+// The compiler writes a C file that is included into the function
+// `mind()` when the kernel is compiled with MIND_AOT. It contains:
+//
+// - An image: a copy of all dictionary entries that are reachable
+//   from the root word, with their bodies. Pointers inside are
+//   relocated.
+//
+// - The code for the colon definitions in the image, in the style of
+//   the inner interpreter. Literals and branches become C statements,
+//   calls between compiled words become jumps. After a call, the
+//   return stack contains a pointer to a "resume pair" { &pair[1],
+//   &&label }, so that for the called word it looks like threaded
+//   code that continues at *label*.
+//
+// - A label `aot_start` at which the program starts.
+//
+// Words that use `does>`, `rp!` or local variables are not compiled
+// but copied as threaded code, and so is every word whose body cannot
+// be decoded.
+
+#include "aot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// How a cell in the body of a colon definition is used
+enum { CELL_DATA, CELL_INSN, CELL_OPERAND };
+
+// How a dictionary entry is translated
+enum { OBJ_DATA, OBJ_DIRECT, OBJ_THREADED };
+
+// A dictionary entry together with its body
+typedef struct {
+    entry_t *e;
+    cell end;                   // (char*) End of the body
+    int reached;                // flag: The entry is part of the program
+    int mode;                   // OBJ_*
+    cell offset;                // Position in the image, in cells
+    char *kind;                 // CELL_* for each cell in the body
+    char *label;                // flag for each cell: label needed
+    cell *pair;                 // Resume pair for each cell, or -1
+    int tail;                   // flag: Target of a tail call
+} obj_t;
+
+static aot_kernel_t *K;
+static obj_t *objs;             // All entries in memory, in this order
+static cell num_objs;
+static obj_t **todo;            // Reached entries that are not yet scanned
+static cell num_todo;
+static char *kernel_reached;    // flag for each kernel word
+static cell image_size;         // Size of the image without pairs, in cells
+static cell num_pairs;
+static obj_t **pair_obj;        // For each resume pair: entry and cell
+static cell *pair_cell;
+
+static cell xt_inlined;         // XT of `'inlined`, or 0
+static cell xt_does;            // XT of `does>`, or 0
+
+#define HEADER_CELLS  (offsetof(entry_t, body) / sizeof(cell))
+
+static int in_mem(cell addr)
+{
+    return addr >= K->mem && addr < K->here;
+}
+
+static int in_dict(cell addr)
+{
+    return addr >= (cell)K->dict && addr < (cell)(K->dict + K->num_words);
+}
+
+static cell body_cells(obj_t *o)
+{
+    return (o->end - (cell)o->e->body + sizeof(cell) - 1) / sizeof(cell);
+}
+
+/* ---------------------------------------------------------------------- */
+/* Dictionary entries */
+
+static void collect_objects(void)
+{
+    entry_t *e;
+    cell i;
+
+    num_objs = 0;
+    for (e = (entry_t*)K->last; in_mem((cell)e); e = (entry_t*)e->link)
+	num_objs++;
+
+    objs = calloc(num_objs, sizeof(obj_t));
+    i = num_objs;
+    for (e = (entry_t*)K->last; in_mem((cell)e); e = (entry_t*)e->link)
+	objs[--i].e = e;
+
+    // A body ends at the name of the next entry, or at the next entry.
+    for (i = 0; i < num_objs; i++) {
+	obj_t *o = &objs[i];
+
+	if (i + 1 == num_objs)
+	    o->end = K->here;
+	else {
+	    entry_t *next = objs[i + 1].e;
+
+	    o->end = (cell)next;
+	    if (next->name >= (cell)o->e->body && next->name < o->end)
+		o->end = next->name;
+	}
+    }
+}
+
+// Find the entry that contains *addr*, or return NULL.
+static obj_t *find_obj(cell addr)
+{
+    cell lo = 0, hi = num_objs;
+
+    if (!in_mem(addr))
+	return NULL;
+    while (hi - lo > 1) {
+	cell mid = (lo + hi) / 2;
+
+	if ((cell)objs[mid].e <= addr)
+	    lo = mid;
+	else
+	    hi = mid;
+    }
+    if (num_objs && addr >= (cell)objs[lo].e && addr < objs[lo].end)
+	return &objs[lo];
+    return NULL;
+}
+
+static cell kernel_index(cell addr)
+{
+    return (addr - (cell)K->dict) / sizeof(entry_t);
+}
+
+static int is_xt(cell addr)
+{
+    obj_t *o;
+
+    if (in_dict(addr))
+	return (addr - (cell)K->dict) % sizeof(entry_t)
+	    == offsetof(entry_t, xt);
+    o = find_obj(addr);
+    return o && addr == (cell)&o->e->xt;
+}
+
+// Return the XT of the word *name*.
+static cell find_user_word(char *name)
+{
+    cell i;
+
+    for (i = num_objs - 1; i >= 0; i--)
+	if (!strcmp((char*)objs[i].e->name, name))
+	    return (cell)&objs[i].e->xt;
+    return 0;
+}
+
+// Is *xt* a colon definition that is followed by inlined data?
+static int takes_inlined(cell xt)
+{
+    entry_t *e = FROM_XT(xt);
+
+    return xt_inlined && find_obj(xt) && e->xt == K->docol
+	&& e->body[0] == xt_inlined;
+}
+
+static const char *routine_name(cell addr)
+{
+    cell i;
+
+    for (i = 0; i < K->num_routines; i++)
+	if (K->routines[i].addr == addr)
+	    return K->routines[i].name;
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Decoding of colon definitions */
+
+// Index of the body cell at *addr*, or -1.
+static cell body_index(obj_t *o, cell addr)
+{
+    cell offset = addr - (cell)o->e->body;
+
+    if (offset < 0 || offset % sizeof(cell)
+	|| offset >= body_cells(o) * (cell)sizeof(cell))
+	return -1;
+    return offset / sizeof(cell);
+}
+
+// Find the instructions in the body of *o*. Return 0 if this is not
+// possible.
+static int decode(obj_t *o)
+{
+    cell n = body_cells(o);
+    cell *body = o->e->body;
+    cell *stack = malloc((2 * n + 1) * sizeof(cell));
+    cell sp = 0;
+    int ok = 1;
+
+    o->kind = calloc(n + 1, 1);
+    o->label = calloc(n + 1, 1);
+
+#define OPERAND(j)							\
+    if ((j) >= n || o->kind[j] != CELL_DATA) goto fail;		\
+    o->kind[j] = CELL_OPERAND
+
+    stack[sp++] = 0;
+    while (sp) {
+	cell i = stack[--sp], xt, target;
+
+	if (i < 0 || i >= n)
+	    goto fail;
+	if (o->kind[i] == CELL_INSN)
+	    continue;
+	if (o->kind[i] != CELL_DATA || !is_xt(body[i]))
+	    goto fail;
+
+	o->kind[i] = CELL_INSN;
+	xt = body[i];
+	if (xt == xt_does || xt == K->rpstore || xt == K->locals)
+	    o->mode = OBJ_THREADED;
+
+	if (xt == K->lit) {
+	    OPERAND(i + 1);
+	    stack[sp++] = i + 2;
+	} else if (xt == K->branch || xt == K->zbranch) {
+	    OPERAND(i + 1);
+	    if ((target = body_index(o, body[i + 1])) < 0)
+		goto fail;
+	    o->label[target] = 1;
+	    stack[sp++] = target;
+	    if (xt == K->zbranch)
+		stack[sp++] = i + 2;
+	} else if (xt == K->tail_call) {
+	    OPERAND(i + 1);
+	} else if (xt == K->locals || xt == K->local_fetch
+		   || xt == K->local_store) {
+	    OPERAND(i + 1);
+	    stack[sp++] = i + 2;
+	} else if (xt == K->semi || xt == K->exit_locals) {
+	    // No successor
+	} else if (xt == K->if_semi || xt == K->zero_semi) {
+	    stack[sp++] = i + 1;
+	} else if (takes_inlined(xt)) {
+	    cell j;
+
+	    if ((target = body_index(o, body[i + 1])) <= i + 1)
+		goto fail;
+	    for (j = i + 1; j < target; j++) {
+		OPERAND(j);
+	    }
+	    o->label[target] = 1;
+	    stack[sp++] = target;
+	} else {
+	    o->label[i + 1] = 1;
+	    stack[sp++] = i + 1;
+	}
+    }
+#undef OPERAND
+
+    if (0) {
+    fail:
+	ok = 0;
+    }
+    free(stack);
+    return ok;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Reachability */
+
+static void reach(cell addr)
+{
+    obj_t *o;
+
+    if ((o = find_obj(addr))) {
+	if (!o->reached) {
+	    o->reached = 1;
+	    todo[num_todo++] = o;
+	}
+    } else if (in_dict(addr)) {
+	cell k = kernel_index(addr);
+
+	if (!kernel_reached[k]) {
+	    kernel_reached[k] = 1;
+	    if (K->dict[k].xt == K->dodefer)
+		reach(K->dict[k].doer);
+	}
+    }
+}
+
+static void scan(obj_t *o)
+{
+    cell i, n = body_cells(o);
+
+    reach(o->e->doer);
+    if (o->e->xt == K->docol) {
+	o->mode = OBJ_DIRECT;
+	if (!decode(o))
+	    o->mode = OBJ_THREADED;
+    }
+    for (i = 0; i < n; i++)
+	reach(o->e->body[i]);
+}
+
+static void layout(void)
+{
+    cell i;
+
+    image_size = 0;
+    for (i = 0; i < num_objs; i++) {
+	obj_t *o = &objs[i];
+	cell j, n = body_cells(o);
+
+	if (!o->reached)
+	    continue;
+	o->offset = image_size;
+	image_size += HEADER_CELLS + n;
+	o->pair = malloc(n * sizeof(cell));
+	for (j = 0; j < n; j++)
+	    o->pair[j] = -1;
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+/* Translation of cells */
+
+// Image index of the resume pair for body cell *i* of *o*.
+static cell pair(obj_t *o, cell i)
+{
+    if (o->pair[i] < 0) {
+	pair_obj = realloc(pair_obj, (num_pairs + 1) * sizeof(obj_t*));
+	pair_cell = realloc(pair_cell, (num_pairs + 1) * sizeof(cell));
+	pair_obj[num_pairs] = o;
+	pair_cell[num_pairs] = i;
+	o->pair[i] = image_size + 2 * num_pairs++;
+	o->label[i] = 1;
+    }
+    return o->pair[i];
+}
+
+// Return a C expression for the cell value *x*. If *code* is true, a
+// pointer to an instruction of a compiled word becomes a pointer to a
+// resume pair.
+static const char *expr(cell x, int code)
+{
+    static char buf[256];
+    obj_t *o;
+    const char *name;
+
+    if (x == 0)
+	return "0";
+    if ((o = find_obj(x)) && o->reached) {
+	cell offset = x - (cell)o->e;
+
+	if (code && o->mode == OBJ_DIRECT) {
+	    cell i = body_index(o, x);
+
+	    if (i >= 0 && o->kind[i] == CELL_INSN) {
+		sprintf(buf, "(cell)&aot_image[%"PRIdCELL"]", pair(o, i));
+		return buf;
+	    }
+	}
+	if (offset % sizeof(cell))
+	    sprintf(buf, "(cell)((char*)&aot_image[%"PRIdCELL"] + %"PRIdCELL")",
+		    o->offset, offset);
+	else
+	    sprintf(buf, "(cell)&aot_image[%"PRIdCELL"]",
+		    o->offset + offset / (cell)sizeof(cell));
+	return buf;
+    }
+    if (in_dict(x)) {
+	cell k = kernel_index(x);
+	cell offset = x - (cell)&K->dict[k];
+
+	if (offset == offsetof(entry_t, xt))
+	    sprintf(buf, "C(%s)", K->labels[k]);
+	else
+	    sprintf(buf, "(cell)((char*)&dict[i_%s] + %"PRIdCELL")",
+		    K->labels[k], offset);
+	return buf;
+    }
+    if (x >= K->sys && x < K->sys + K->per_sys) {
+	sprintf(buf, "(cell)((char*)&sys + %"PRIdCELL")", x - K->sys);
+	return buf;
+    }
+    if ((name = routine_name(x))) {
+	sprintf(buf, "(cell)&&%s", name);
+	return buf;
+    }
+    if (x == (cell)stdin)
+	return "(cell)stdin";
+    if (x == (cell)stdout)
+	return "(cell)stdout";
+    if (x == (cell)stderr)
+	return "(cell)stderr";
+
+    sprintf(buf, "(cell)0x%"PRIxCELL, x);
+    return buf;
+}
+
+static void put_string(FILE *out, const char *s)
+{
+    putc('"', out);
+    for (; *s; s++) {
+	if (*s == '"' || *s == '\\')
+	    fprintf(out, "\\%c", *s);
+	else if (*s < ' ' || *s > '~')
+	    fprintf(out, "\\%03o", (unsigned char)*s);
+	else
+	    putc(*s, out);
+    }
+    putc('"', out);
+}
+
+/* ---------------------------------------------------------------------- */
+/* Output */
+
+static void write_image(FILE *out)
+{
+    cell i, j;
+
+    fprintf(out, "static cell aot_image[] = {\n");
+    for (i = 0; i < num_objs; i++) {
+	obj_t *o = &objs[i];
+	cell n = body_cells(o);
+
+	if (!o->reached)
+	    continue;
+
+	fprintf(out, "    // ");
+	put_string(out, (char*)o->e->name);
+	fprintf(out, "\n    0, (cell)");
+	put_string(out, (char*)o->e->name);
+	fprintf(out, ", (cell)0x%"PRIxCELL", ", ((cell*)o->e)[2]); // flags
+	if (o->mode == OBJ_DIRECT)
+	    fprintf(out, "(cell)&&aot_%"PRIdCELL, i);
+	else
+	    fprintf(out, "%s", expr(o->e->xt, 0));
+	fprintf(out, ", %s,\n", expr(o->e->doer, 1));
+
+	for (j = 0; j < n; j++)
+	    fprintf(out, "    %s,\n",
+		    expr(o->e->body[j], o->mode != OBJ_DIRECT));
+    }
+
+    // Resume pairs
+    for (i = 0; i < num_pairs; i++)
+	fprintf(out, "    (cell)&aot_image[%"PRIdCELL"], "
+		"(cell)&&aot_%"PRIdCELL"_%"PRIdCELL",\n",
+		image_size + 2 * i + 1, (cell)(pair_obj[i] - objs),
+		pair_cell[i]);
+    fprintf(out, "    0\n};\n\n");
+}
+
+// Write the code for a call to the word *xt* that continues at label
+// *resume*.
+static void write_call(FILE *out, cell xt, const char *resume)
+{
+    obj_t *o = find_obj(xt);
+
+    if (in_dict(xt) && !routine_name(K->dict[kernel_index(xt)].xt))
+	fprintf(out, "    AOT_PRIM(%s, %s);\n",
+		K->labels[kernel_index(xt)], resume);
+    else if (o && o->mode == OBJ_DIRECT)
+	fprintf(out, "    AOT_COLON(aot_%"PRIdCELL", %s);\n",
+		(cell)(o - objs), resume);
+    else
+	fprintf(out, "    AOT_CALL(%s, %s);\n", expr(xt, 0), resume);
+}
+
+// Write the code for a jump to the colon definition *xt*.
+static void write_tail_call(FILE *out, cell xt)
+{
+    obj_t *o = find_obj(xt);
+
+    if (o && o->mode == OBJ_DIRECT) {
+	o->tail = 1;
+	fprintf(out, "    goto aot_%"PRIdCELL"_tail;\n", (cell)(o - objs));
+    } else
+	fprintf(out, "    AOT_TAIL(%s);\n", expr(xt, 0));
+}
+
+static void write_code(FILE *out, cell x)
+{
+    obj_t *o = &objs[x];
+    cell i, n = body_cells(o);
+    cell *body = o->e->body;
+    char resume[64];
+
+    fprintf(out, "// : ");
+    put_string(out, (char*)o->e->name);
+    fprintf(out, "\naot_%"PRIdCELL":\n    RPUSH(ip);\n", x);
+    if (o->tail)
+	fprintf(out, "aot_%"PRIdCELL"_tail:\n", x);
+
+    for (i = 0; i < n; i++) {
+	cell xt = body[i];
+
+	if (o->kind[i] != CELL_INSN)
+	    continue;
+	if (o->label[i])
+	    fprintf(out, "aot_%"PRIdCELL"_%"PRIdCELL":\n", x, i);
+
+	if (xt == K->lit)
+	    fprintf(out, "    PUSH(%s);\n", expr(body[i + 1], 1));
+	else if (xt == K->branch)
+	    fprintf(out, "    goto aot_%"PRIdCELL"_%"PRIdCELL";\n",
+		    x, body_index(o, body[i + 1]));
+	else if (xt == K->zbranch)
+	    fprintf(out, "    if (!*sp++) goto aot_%"PRIdCELL"_%"PRIdCELL";\n",
+		    x, body_index(o, body[i + 1]));
+	else if (xt == K->tail_call)
+	    write_tail_call(out, body[i + 1]);
+	else if (xt == K->semi)
+	    fprintf(out, "    AOT_EXIT;\n");
+	else if (xt == K->if_semi)
+	    fprintf(out, "    if (*sp++) AOT_EXIT;\n");
+	else if (xt == K->zero_semi)
+	    fprintf(out, "    if (!TOS) { DROP(1); AOT_EXIT; }\n");
+	else if (takes_inlined(xt)) {
+	    // The data must be followed by the resume pair.
+	    cell j, end = body_index(o, body[i + 1]);
+	    cell data = end - i - 2;
+
+	    fprintf(out, "    {\n\tstatic cell r[] = { (cell)&r[%"PRIdCELL"],",
+		    data + 1);
+	    for (j = i + 2; j < end; j++)
+		fprintf(out, " (cell)0x%"PRIxCELL",", body[j]);
+	    fprintf(out, "\n\t    (cell)&r[%"PRIdCELL"], "
+		    "(cell)&&aot_%"PRIdCELL"_%"PRIdCELL" };\n",
+		    data + 2, x, end);
+	    fprintf(out, "\tip = r; w = (label_t*)%s; goto **w;\n    }\n",
+		    expr(xt, 0));
+	} else {
+	    sprintf(resume, "aot_%"PRIdCELL"_%"PRIdCELL, x, i + 1);
+	    write_call(out, xt, resume);
+	}
+    }
+    fprintf(out, "\n");
+}
+
+static void write_program(FILE *out, cell root)
+{
+    cell i;
+
+    fprintf(out, "// Generated by compile-to-c from the word ");
+    put_string(out, is_xt(root) ? (char*)FROM_XT(root)->name : "?");
+    fprintf(out, ".\n// Compile it with: make <program> "
+	    "(for the file <program>.aot.c)\n\n");
+
+    write_image(out);
+
+    fprintf(out, "aot_start:\n");
+    for (i = 0; i < K->num_words; i++)
+	if (kernel_reached[i] && K->dict[i].xt == K->dodefer)
+	    fprintf(out, "    dict[i_%s].doer = %s;\n",
+		    K->labels[i], expr(K->dict[i].doer, 1));
+    fprintf(out, "    {\n\tstatic cell boot[] = { %s, C(bye) };\n",
+	    expr(root, 0));
+    fprintf(out, "\tip = boot;\n\tgoto next;\n    }\n\n");
+
+    for (i = 0; i < num_objs; i++)
+	if (objs[i].reached && objs[i].mode == OBJ_DIRECT)
+	    write_code(out, i);
+}
+
+static void cleanup(void)
+{
+    cell i;
+
+    for (i = 0; i < num_objs; i++) {
+	free(objs[i].kind);
+	free(objs[i].label);
+	free(objs[i].pair);
+    }
+    free(objs);
+    free(todo);
+    free(kernel_reached);
+    free(pair_obj);
+    free(pair_cell);
+    pair_obj = NULL;
+    pair_cell = NULL;
+}
+
+void compile_to_c(aot_kernel_t *kernel, cell xt, char *path)
+{
+    FILE *out, *null;
+
+    K = kernel;
+    collect_objects();
+    xt_inlined = find_user_word("'inlined");
+    xt_does = find_user_word("does>");
+
+    todo = malloc((num_objs + 1) * sizeof(obj_t*));
+    num_todo = 0;
+    kernel_reached = calloc(K->num_words, 1);
+    reach(xt);
+    while (num_todo)
+	scan(todo[--num_todo]);
+    layout();
+
+    // First pass: find the resume pairs and labels that are needed.
+    num_pairs = 0;
+    if ((null = fopen("/dev/null", "w"))) {
+	write_program(null, xt);
+	fclose(null);
+    }
+
+    if ((out = fopen(path, "w"))) {
+	write_program(out, xt);
+	if (!fclose(out))
+	    errno = 0;          // Reset errno if no error occured
+    }
+    cleanup();
+}
@@ -0,0 +1,46 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the ahead-of-time compiler from the dictionary
+// to C.
+
+#ifndef AOT_H
+#define AOT_H
+
+#include "dict.h"
+
+// A piece of kernel code that is not a word, like `docol`.
+typedef struct {
+    const char *name;           // C label
+    cell addr;                  // (label_t) Address of the label
+} routine_t;
+
+// The parts of the kernel that the compiler needs to know.
+typedef struct {
+    entry_t *dict;              // Kernel dictionary
+    cell num_words;             // Number of entries in `dict`
+    const char **labels;        // C label of each kernel word
+    routine_t *routines;        // Interpreter routines and call stubs
+    cell num_routines;
+    cell last;                  // (entry_t*) Newest dictionary entry
+    cell mem;                   // (cell*) Start of the main memory
+    cell here;                  // (cell*) End of the dictionary
+    cell sys;                   // Address of the system variables
+    cell per_sys;               // Size of the system variables
+    cell docol;                 // (label_t) Runtime of ":"
+    cell dodefer;               // (label_t) Runtime of Defer
+
+    // XTs of the words that are compiled to control flow
+    cell lit, branch, zbranch, tail_call, semi, if_semi, zero_semi, rpstore;
+
+    // XTs of the words for local variables
+    cell locals, local_fetch, local_store, exit_locals;
+} aot_kernel_t;
+
+void compile_to_c(aot_kernel_t *kernel, cell xt, char *path);
+
+#endif
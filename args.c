@@ -16,10 +16,14 @@ args_t args;
 
 static void usage(char *progname)
 {
-    printf("Usage: %s [-e cmd | -x cmd | -h ]\n", progname);
+    printf("Usage: %s [-e cmd | -x cmd | -h ] [-m file] [-S socket | -C socket]\n",
+	   progname);
     printf("Options and arguments:\n");
     printf("-e cmd: Execute cmd and then stop\n");
     printf("-x cmd: Execute cmd, then start command prompt.\n");
+    printf("-m file: Write runtime metrics to file\n");
+    printf("-S socket: Serve commands on socket\n");
+    printf("-C socket: Send cmd or the input to the server on socket\n");
     printf("-h    : Print this help text\n");
 }
 
@@ -42,9 +46,12 @@ void init_args(int argc, char *argv[])
     // Default: start in interactive mode
     args.command = 0;
     args.interactive = TRUE;
+    args.metrics = 0;
+    args.server = 0;
+    args.client = 0;
 
     int opt;
-    while ((opt = getopt(argc, argv, "he:x:")) != -1) {
+    while ((opt = getopt(argc, argv, "he:x:m:S:C:")) != -1) {
 	switch (opt) {
 	case 'h':
             usage(argv[0]);
@@ -57,6 +64,16 @@ void init_args(int argc, char *argv[])
 	    args.command = (cell)optarg;
 	    args.interactive = TRUE;
 	    break;
+	case 'm':
+	    args.metrics = (cell)optarg;
+	    break;
+	case 'S':
+	    args.server = (cell)optarg;
+	    args.interactive = FALSE;
+	    break;
+	case 'C':
+	    args.client = (cell)optarg;
+	    break;
 	default:
 	    exit(-1);
 	}
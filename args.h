@@ -20,6 +20,9 @@ typedef struct {
     cell progname;              // (char*) argv[0]
     cell command;		// (char*) command parameter
     cell interactive;		// flag: start the interactive mode
+    cell metrics;               // (char*) File for the metrics, or 0
+    cell server;                // (char*) Socket of the server mode, or 0
+    cell client;                // (char*) Socket to send the command to, or 0
 } args_t;
 
 extern args_t args;
@@ -0,0 +1,435 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the cache for compiled source files.
+//
+// When a file is compiled by `require`, the part of the dictionary
+// that it created is written to a cache file next to it. The next
+// time the file is required, the cached segment is copied back into
+// memory instead of compiling the file again.
+//
+// The cache is only valid if the file and the dictionary before it
+// are the same as when it was written; both are part of the key. The
+// files that were read while the file was compiled, with `include` or
+// `require`, are stored in the cache file with the hash of their
+// content, and the cache is not used if one of them has changed.
+//
+// The addresses of the kernel, the system variables and the main
+// memory change between runs, but they all lie in the executable and
+// move by the same amount. When the segment is written, every cell
+// that points into the executable is marked in a bitmap, and when it
+// is loaded, these cells are moved by the difference between the old
+// and the new start of the executable.
+//
+// Other addresses, like those of `malloc`, a region or a C library,
+// are different in the next run. A segment that contains a value
+// which points into memory that is mapped outside the executable is
+// therefore not cached.
+//
+// A file is only cached if it changed no dictionary entry outside of
+// its own segment, for example with `is` or `immediate`. Values that
+// it stores in variables of other files are not part of the cache.
+
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Start and end of the executable, provided by the linker
+extern char __executable_start[], _end[];
+
+#define CACHE_MAGIC  0x6d696e32     // "min2"
+
+// Header of a cache file. It is followed by the segment, the
+// relocation bitmap and the files that the source file read. For
+// each of them there is the hash of its content, the length of its
+// name including the final 0, and the name.
+typedef struct {
+    cell magic;
+    cell key;                   // Cache key of the source file
+    cell base;                  // Start of the executable when written
+    cell start;                 // Offset of the segment in the memory
+    cell size;                  // Size of the segment in bytes
+    cell last;                  // Newest entry after compiling
+    cell files;                 // Number of files read
+} cache_header_t;
+
+// FNV-1a parameters for the size of a cell
+#if INTPTR_MAX <= INT_MAX
+#define FNV_BASIS  ((cell)(ucell)0x811c9dc5)
+#define FNV_PRIME  ((ucell)0x01000193)
+#else
+#define FNV_BASIS  ((cell)(ucell)0xcbf29ce484222325)
+#define FNV_PRIME  ((ucell)0x100000001b3)
+#endif
+
+// The files that are being compiled, newest first, and the names of
+// the files that were read since the oldest of them started.
+static cache_mark_t *marks;
+
+static struct {
+    char **names;
+    cell count, size;
+} read_files;
+
+static int in_executable(cell x)
+{
+    return x >= (cell)__executable_start && x < (cell)_end;
+}
+
+// Address-independent form of x, for the key
+static cell normalize(cell x)
+{
+    return in_executable(x) ? x - (cell)__executable_start : x;
+}
+
+// FNV-1a
+static cell hash_bytes(cell h, const void *p, size_t n)
+{
+    const unsigned char *s = p;
+    ucell u = h;
+
+    while (n--)
+	u = (u ^ *s++) * FNV_PRIME;
+    return u;
+}
+
+static cell hash_cell(cell h, cell x)
+{
+    return hash_bytes(h, &x, sizeof(cell));
+}
+
+static char *cache_path(char *path)
+{
+    char *cpath = malloc(strlen(path) + sizeof(".cache"));
+
+    sprintf(cpath, "%s.cache", path);
+    return cpath;
+}
+
+// Hash of the content of the file *path*, starting with *h*. Returns
+// 0 if the file cannot be read.
+static cell hash_file(cell h, char *path)
+{
+    char buf[4096];
+    size_t n;
+    FILE *f;
+    int saved_errno = errno;
+
+    if (!(f = fopen(path, "r"))) {
+	errno = saved_errno;
+	return 0;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), f)))
+	h = hash_bytes(h, buf, n);
+    fclose(f);
+    errno = saved_errno;
+    return h ? h : 1;
+}
+
+// Key of the file *path*, compiled on top of the current dictionary.
+// Returns 0 if the file cannot be read.
+cell cache_key(cache_env_t *env, char *path)
+{
+    cell h = hash_file(FNV_BASIS, path);
+    entry_t *e;
+
+    if (!h)
+	return 0;
+    h = hash_cell(h, *env->dp - (cell)env->mem);
+    for (e = (entry_t*)*env->last; e; e = (entry_t*)e->link) {
+	h = hash_cell(h, normalize((cell)e));
+	h = hash_bytes(h, (char*)e->name, strlen((char*)e->name));
+	h = hash_cell(h, e->flags);
+	h = hash_cell(h, normalize(e->xt));
+	h = hash_cell(h, normalize(e->doer));
+    }
+    return h ? h : 1;
+}
+
+// The file *path* is read. If a file is being compiled, the cache of
+// that file depends on it.
+void cache_read(char *path)
+{
+    if (!marks)
+	return;
+    if (read_files.count == read_files.size) {
+	read_files.size = read_files.size ? 2 * read_files.size : 16;
+	read_files.names = realloc(read_files.names,
+				   read_files.size * sizeof(char*));
+    }
+    read_files.names[read_files.count++] = strdup(path);
+}
+
+static void forget_read_files(cell count)
+{
+    while (read_files.count > count)
+	free(read_files.names[--read_files.count]);
+}
+
+// Read the names of the *n* files that the cached file read, and
+// check that none of them has changed. If a file is being compiled,
+// they are also read by that file.
+static int read_files_valid(FILE *f, cell n)
+{
+    cell key, len;
+    char *name;
+    int ok = 1;
+
+    while (ok && n--) {
+	if (fread(&key, sizeof(cell), 1, f) != 1
+	    || fread(&len, sizeof(cell), 1, f) != 1 || len <= 0 || len > PATH_MAX)
+	    return 0;
+	name = malloc(len);
+	ok = fread(name, 1, len, f) == (size_t)len && !name[len - 1]
+	    && key && hash_file(FNV_BASIS, name) == key;
+	if (ok)
+	    cache_read(name);
+	free(name);
+    }
+    return ok;
+}
+
+// Load the cached segment of *path* if its key is *key*. Returns
+// true on success.
+int cache_load(cache_env_t *env, char *path, cell key)
+{
+    char *cpath = cache_path(path);
+    FILE *f = fopen(cpath, "r");
+    int saved_errno = errno;
+    int ok = 0;
+    cache_header_t h;
+    cell bias, ncells, i;
+    unsigned char *bitmap = NULL;
+    cell *seg = (cell*)*env->dp;
+    cell nread = read_files.count;
+
+    free(cpath);
+    if (!f)
+	goto done;
+    if (fread(&h, sizeof(h), 1, f) != 1
+	|| h.magic != (cell)CACHE_MAGIC || h.key != key
+	|| h.start != *env->dp - (cell)env->mem
+	|| *env->dp + h.size > (cell)env->mem_end)
+	goto done;
+
+    ncells = h.size / (cell)sizeof(cell);
+    bitmap = malloc(ncells / 8 + 1);
+    if (fread(seg, 1, h.size, f) != (size_t)h.size
+	|| fread(bitmap, 1, ncells / 8 + 1, f) != (size_t)(ncells / 8 + 1)
+	|| !read_files_valid(f, h.files))
+	goto done;
+    cache_read(path);
+
+    bias = (cell)__executable_start - h.base;
+    for (i = 0; i < ncells; i++)
+	if (bitmap[i / 8] & (1 << (i % 8)))
+	    seg[i] += bias;
+    *env->dp += h.size;
+    *env->last = h.last + bias;
+    ok = 1;
+
+done:
+    if (f)
+	fclose(f);
+    if (!ok)
+	forget_read_files(nread);
+    free(bitmap);
+    errno = saved_errno;
+    return ok;
+}
+
+// Remember the state before the file with *key* is compiled.
+cache_mark_t *cache_mark(cache_env_t *env, cell key)
+{
+    cache_mark_t *mark = malloc(sizeof(cache_mark_t));
+    cell size = *env->dp - (cell)env->mem;
+
+    mark->key = key;
+    mark->start = *env->dp;
+    mark->last = *env->last;
+    mark->mem = malloc(size);
+    memcpy(mark->mem, env->mem, size);
+    mark->dict = malloc(env->num_words * sizeof(entry_t));
+    memcpy(mark->dict, env->dict, env->num_words * sizeof(entry_t));
+    mark->read = read_files.count;
+    mark->prev = marks;
+    return marks = mark;
+}
+
+static void mark_free(cache_mark_t *mark)
+{
+    cache_mark_t **p;
+
+    for (p = &marks; *p; p = &(*p)->prev)
+	if (*p == mark) {
+	    *p = mark->prev;
+	    break;
+	}
+    if (!marks)
+	forget_read_files(0);
+    free(mark->mem);
+    free(mark->dict);
+    free(mark);
+}
+
+// An abort left all files that were compiled.
+void cache_abort(void)
+{
+    while (marks)
+	mark_free(marks);
+}
+
+// Have the headers of the dictionary entries before *mark* changed?
+static int headers_changed(cache_env_t *env, cache_mark_t *mark)
+{
+    entry_t *e;
+
+    if (memcmp(mark->dict, env->dict, env->num_words * sizeof(entry_t)))
+	return 1;
+    for (e = (entry_t*)mark->last;
+	 (cell)e >= (cell)env->mem && (cell)e < mark->start;
+	 e = (entry_t*)e->link) {
+	char *old = (char*)mark->mem + ((cell)e - (cell)env->mem);
+
+	if (memcmp(old, e, sizeof(entry_t)))
+	    return 1;
+    }
+    return 0;
+}
+
+// The mappings of the process, from /proc/self/maps, in ascending
+// order. Returns their number, or -1 if they cannot be read.
+typedef struct {
+    ucell from, to;
+} mapping_t;
+
+static cell read_mappings(mapping_t **v)
+{
+    FILE *f = fopen("/proc/self/maps", "r");
+    unsigned long from, to;
+    cell n = 0, size = 0;
+
+    *v = NULL;
+    if (!f)
+	return -1;
+    while (fscanf(f, "%lx-%lx%*[^\n]", &from, &to) == 2) {
+	if (n == size) {
+	    size = size ? 2 * size : 64;
+	    *v = realloc(*v, size * sizeof(mapping_t));
+	}
+	(*v)[n++] = (mapping_t) { from, to };
+    }
+    fclose(f);
+    return n;
+}
+
+// Does the segment contain a value that points into mapped memory
+// outside the executable? If the mappings are unknown, it may.
+static int foreign_pointers(cell *seg, cell ncells)
+{
+    mapping_t *v;
+    cell n = read_mappings(&v), i;
+    int found = n < 0;
+
+    for (i = 0; i < ncells && !found; i++) {
+	ucell x = seg[i];
+	cell lo = 0, hi = n;
+
+	if (in_executable(seg[i]))
+	    continue;
+	while (lo < hi) {
+	    cell mid = (lo + hi) / 2;
+
+	    if (v[mid].to <= x)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	found = lo < n && v[lo].from <= x;
+    }
+    free(v);
+    return found;
+}
+
+// Write the names of the files that were read since *mark*, except
+// *path* itself, with the hashes of their content. Returns their
+// number.
+static cell write_read_files(FILE *f, char *path, cache_mark_t *mark)
+{
+    cell i, j, n = 0;
+
+    for (i = mark->read; i < read_files.count; i++) {
+	char *name = read_files.names[i];
+	cell key, len = strlen(name) + 1;
+
+	for (j = mark->read; j < i; j++)
+	    if (!strcmp(read_files.names[j], name))
+		break;
+	if (j < i || !strcmp(name, path))
+	    continue;
+	key = hash_file(FNV_BASIS, name);
+	fwrite(&key, sizeof(cell), 1, f);
+	fwrite(&len, sizeof(cell), 1, f);
+	fwrite(name, 1, len, f);
+	n++;
+    }
+    return n;
+}
+
+// Write the segment that was compiled since *mark* to the cache file
+// of *path*, if the compilation had no other effects and the segment
+// is valid in another run. Frees *mark*.
+void cache_save(cache_env_t *env, char *path, cache_mark_t *mark)
+{
+    cell size = *env->dp - mark->start;
+    cell ncells = size / (cell)sizeof(cell);
+    cell *seg = (cell*)mark->start;
+    unsigned char *bitmap;
+    cache_header_t h;
+    char *cpath;
+    FILE *f;
+    cell i;
+    int saved_errno = errno;
+
+    if (!mark->key || size < 0 || *env->state || headers_changed(env, mark)
+	|| foreign_pointers(seg, ncells))
+	goto done;
+
+    h = (cache_header_t) {
+	.magic = (cell)CACHE_MAGIC,
+	.key   = mark->key,
+	.base  = (cell)__executable_start,
+	.start = mark->start - (cell)env->mem,
+	.size  = size,
+	.last  = *env->last,
+    };
+    bitmap = calloc(ncells / 8 + 1, 1);
+    for (i = 0; i < ncells; i++)
+	if (in_executable(seg[i]))
+	    bitmap[i / 8] |= 1 << (i % 8);
+
+    cpath = cache_path(path);
+    if ((f = fopen(cpath, "w"))) {
+	fwrite(&h, sizeof(h), 1, f);
+	fwrite(seg, 1, size, f);
+	fwrite(bitmap, 1, ncells / 8 + 1, f);
+	h.files = write_read_files(f, path, mark);
+	rewind(f);
+	fwrite(&h, sizeof(h), 1, f);
+	if (ferror(f) | fclose(f))
+	    remove(cpath);
+    }
+    free(cpath);
+    free(bitmap);
+
+done:
+    mark_free(mark);
+    errno = saved_errno;
+}
@@ -0,0 +1,44 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the cache for compiled source files.
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "dict.h"
+
+// The parts of the system that a compiled file can change.
+typedef struct {
+    cell *mem;                  // Start of the main memory
+    cell *mem_end;              // End of the main memory
+    cell *dp;                   // (cell*) Address of the dictionary pointer
+    cell *last;                 // (entry_t*) Address of the newest entry
+    cell *state;                // Address of the compiler state
+    entry_t *dict;              // Kernel dictionary
+    cell num_words;             // Number of entries in `dict`
+} cache_env_t;
+
+// State of the system before a file is compiled
+typedef struct cache_mark_s {
+    struct cache_mark_s *prev;  // File that is compiled around this one
+    cell key;                   // Cache key of the file
+    cell start;                 // Value of `here` before compiling
+    cell last;                  // Value of `last` before compiling
+    cell *mem;                  // Copy of the memory below `start`
+    entry_t *dict;              // Copy of the kernel dictionary
+    cell read;                  // Files read before this one started
+} cache_mark_t;
+
+cell cache_key(cache_env_t *env, char *path);
+int cache_load(cache_env_t *env, char *path, cell key);
+cache_mark_t *cache_mark(cache_env_t *env, cell key);
+void cache_save(cache_env_t *env, char *path, cache_mark_t *mark);
+void cache_read(char *path);
+void cache_abort(void);
+
+#endif
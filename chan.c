@@ -0,0 +1,149 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains channels: bounded queues of cells with one
+// writer and one reader, without locks.
+//
+// The interpreter has a single set of system variables, so the stages
+// of a pipeline run in separate processes, created by `fork`. A
+// channel is therefore allocated in shared memory before the fork.
+//
+// The writer only changes `head`, the reader only `tail`. A side that
+// has to wait first tries `spin` times, and then sleeps on a futex
+// until the other side wakes it up.
+
+#include "chan.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define LOAD(x)      __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define STORE(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+// A channel for at least *size* cells, or NULL on error.
+chan_t *chan_new(cell size)
+{
+    cell n = 1;
+    chan_t *c;
+
+    while (n < size)
+	n *= 2;
+    c = mmap(NULL, sizeof(chan_t) + n * sizeof(cell), PROT_READ | PROT_WRITE,
+	     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (c == MAP_FAILED)
+	return NULL;
+    c->mask = n - 1;
+    c->spin = 1000;
+    errno = 0;
+    return c;
+}
+
+void chan_free(chan_t *c)
+{
+    munmap(c, sizeof(chan_t) + (c->mask + 1) * sizeof(cell));
+}
+
+static void futex_wait(int *addr, int val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+static void futex_wake(int *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Wait until *counter* is no longer *old*, or the channel is closed.
+static void wait_change(chan_t *c, cell *counter, cell old,
+			int *event, int *waits)
+{
+    cell i;
+
+    for (i = 0; i < c->spin; i++)
+	if (LOAD(*counter) != old || LOAD(c->closed))
+	    return;
+    while (LOAD(*counter) == old && !LOAD(c->closed)) {
+	int ev = LOAD(*event);
+
+	STORE(*waits, 1);
+	if (LOAD(*counter) == old && !LOAD(c->closed))
+	    futex_wait(event, ev);
+	STORE(*waits, 0);
+    }
+}
+
+// Wake up the other side if it sleeps on *event*.
+static void wake(int *event, int *waits)
+{
+    if (LOAD(*waits)) {
+	__atomic_fetch_add(event, 1, __ATOMIC_SEQ_CST);
+	futex_wake(event);
+    }
+}
+
+void chan_close(chan_t *c)
+{
+    STORE(c->closed, 1);
+    wake(&c->data_event, &c->reader_waits);
+}
+
+// Send *n* cells from *from*. Waits while the channel is full.
+void chan_send_n(chan_t *c, cell *from, cell n)
+{
+    cell head = c->head;
+
+    while (n > 0) {
+	cell tail = LOAD(c->tail);
+	cell free = c->mask + 1 - (head - tail);
+
+	if (!free) {
+	    wait_change(c, &c->tail, tail, &c->space_event, &c->writer_waits);
+	    continue;
+	}
+	if (free > n)
+	    free = n;
+	for (n -= free; free--; head++)
+	    c->buf[head & c->mask] = *from++;
+	STORE(c->head, head);
+	wake(&c->data_event, &c->reader_waits);
+    }
+}
+
+// Receive up to *n* cells into *to*. Waits until at least one cell
+// is there; returns 0 only if the channel is closed and empty.
+cell chan_recv_n(chan_t *c, cell *to, cell n)
+{
+    cell tail = c->tail;
+    cell head, avail, i;
+
+    while ((head = LOAD(c->head)) == tail) {
+	if (LOAD(c->closed) && LOAD(c->head) == tail)
+	    return 0;
+	wait_change(c, &c->head, tail, &c->data_event, &c->reader_waits);
+    }
+    avail = head - tail < n ? head - tail : n;
+    for (i = 0; i < avail; i++, tail++)
+	to[i] = c->buf[tail & c->mask];
+    STORE(c->tail, tail);
+    wake(&c->space_event, &c->writer_waits);
+    return avail;
+}
+
+void chanstream_open(chanstream_t *s, chan_t *c)
+{
+    s->chan = (cell)c;
+    chanstream_get(s);
+}
+
+void chanstream_get(chanstream_t *s)
+{
+    s->valid = chan_recv_n((chan_t*)s->chan, &s->current, 1) ? TRUE : FALSE;
+}
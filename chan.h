@@ -0,0 +1,54 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains channels: queues of cells between two processes.
+
+#ifndef CHAN_H
+#define CHAN_H
+
+#include "io.h"
+
+#define CHAN_LINE  64           // Size of a cache line
+
+// A bounded queue with one writer and one reader. The counters are
+// in separate cache lines, so that the two sides do not share a line
+// that one of them writes.
+typedef struct {
+    cell head;                  // Number of cells sent
+    int data_event;             // Changes when the reader is woken up
+    int reader_waits;
+    char pad1[CHAN_LINE - sizeof(cell) - 2 * sizeof(int)];
+
+    cell tail;                  // Number of cells received
+    int space_event;            // Changes when the writer is woken up
+    int writer_waits;
+    char pad2[CHAN_LINE - sizeof(cell) - 2 * sizeof(int)];
+
+    cell mask;                  // Capacity - 1; the capacity is a power of 2
+    cell spin;                  // Tries before a side goes to sleep
+    cell closed;                // flag: nothing more will be sent
+    cell buf[];
+} chan_t;
+
+// A channel viewed as a stream of cells
+typedef struct {
+    stream_t stream;
+    cell chan;                  // (chan_t*) Channel that is read
+    cell current;               // Cell at input position
+    cell valid;                 // flag: `current` contains a cell
+} chanstream_t;
+
+chan_t *chan_new(cell size);
+void chan_free(chan_t *c);
+void chan_close(chan_t *c);
+void chan_send_n(chan_t *c, cell *from, cell n);
+cell chan_recv_n(chan_t *c, cell *to, cell n);
+
+void chanstream_open(chanstream_t *s, chan_t *c);
+void chanstream_get(chanstream_t *s);
+
+#endif
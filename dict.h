@@ -0,0 +1,65 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the structure of the dictionary.
+
+#ifndef DICT_H
+#define DICT_H
+
+#include <stddef.h>
+
+#include "types.h"
+
+/* Interpreter flags */
+#define IMMEDIATE 1
+#define INLINE    2
+#define SEALED    16            // Defer word whose calls go to its target
+#define FIXED     128           // does> word whose body does not change
+
+// Bits 2 and 3 of the flags: the return stack frames that a word
+// reads or changes. 0: none, 1: its own return address, 2: also the
+// return address of its caller, 3: more.
+#define RDEPTH_SHIFT  2
+#define RDEPTH_MASK   (3 << RDEPTH_SHIFT)
+
+// Bits 5 and 6: a kernel word without side effects that is computed
+// at compile time if its arguments are literals. The value is the
+// number of its arguments plus 1.
+#define FOLD_SHIFT    5
+#define FOLD_MASK     (3 << FOLD_SHIFT)
+#define FOLDS(n)      (((n) + 1) << FOLD_SHIFT)
+
+// The flags cell of an entry also contains the length and a hash of
+// the name, above FLAG_MASK. The dictionary search compares them
+// before it reads the name itself.
+#define FLAG_MASK  0xff
+
+typedef void *label_t;		/* Target of computed goto. */
+
+// A dictionary entry. Entries lie between the bodies of the words in
+// the main memory. The memory has 512 KB and the dictionary of
+// init.mind 23 KB, so that headers and code stay in the processor
+// caches together; "Dictionary layout" in bench.mind compares this
+// with dense headers.
+typedef struct {
+    cell link;      // (entry*)  Pointer to previous entry.
+    cell name;      // (char*)   Pointer to start of word name.
+    cell flags;     // Interpreter flags, name length and hash
+    cell xt;        // (label_t) C code that executes this word.
+    cell doer;      // (cell*)   Forth routine for `does>` part.
+    cell body[];
+} entry_t;
+
+// Compute the address of an entry_t field when given an execution
+// token instead of the beginning of the struct.
+#define FROM_XT(addr)                                     \
+    ((entry_t*)((char*)(addr) - offsetof(entry_t, xt)))
+
+#define FROM_BODY(addr)                                 \
+    ((entry_t*)((char*)(addr) - offsetof(entry_t, body)))
+
+#endif
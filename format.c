@@ -0,0 +1,107 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the conversion of numbers to strings.
+//
+// Digits are written backwards, from the end of a buffer. Decimal
+// numbers are converted two digits per division, numbers in a base
+// that is a power of two with shifts; other bases need one division
+// per digit. Digits above 9 are lowercase letters, as in `#`.
+
+#include "format.h"
+
+#include <stdio.h>
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static char digit_char(ucell d)
+{
+    return d < 10 ? '0' + d : 'a' + d - 10;
+}
+
+static char *format_decimal(char *p, ucell u)
+{
+    while (u >= 100) {
+	ucell d = u % 100;
+
+	u /= 100;
+	*--p = digit_pairs[2 * d + 1];
+	*--p = digit_pairs[2 * d];
+    }
+    if (u >= 10) {
+	*--p = digit_pairs[2 * u + 1];
+	*--p = digit_pairs[2 * u];
+    } else
+	*--p = '0' + u;
+    return p;
+}
+
+static char *format_shift(char *p, ucell u, int shift)
+{
+    ucell mask = ((ucell)1 << shift) - 1;
+
+    do {
+	*--p = digit_char(u & mask);
+	u >>= shift;
+    } while (u);
+    return p;
+}
+
+static char *format_divide(char *p, ucell u, ucell base)
+{
+    do {
+	*--p = digit_char(u % base);
+	u /= base;
+    } while (u);
+    return p;
+}
+
+// Write *n* in *base* so that it ends just before *end*, and return
+// the start of the digits. The buffer needs FORMAT_SIZE characters.
+// A base below 2 is taken as decimal.
+char *format_number(char *end, cell n, cell base, int is_signed)
+{
+    ucell u = is_signed && n < 0 ? -(ucell)n : (ucell)n;
+    ucell b = base < 2 ? 10 : (ucell)base;
+    char *p;
+
+    if (b == 10)
+	p = format_decimal(end, u);
+    else if (!(b & (b - 1)))
+	p = format_shift(end, u, __builtin_ctzl(b));
+    else
+	p = format_divide(end, u, b);
+    if (is_signed && n < 0)
+	*--p = '-';
+    return p;
+}
+
+// Print the *n* signed numbers at *v*, each followed by a space, with
+// as few writes as possible.
+void format_cells(cell *v, cell n, cell base)
+{
+    char buf[4096];
+    char *out = buf;
+    char num[FORMAT_SIZE];
+    char *end = num + sizeof(num);
+
+    while (n-- > 0) {
+	char *p = format_number(end, *v++, base, 1);
+
+	if (out + (end - p) + 1 > buf + sizeof(buf)) {
+	    fwrite(buf, 1, out - buf, stdout);
+	    out = buf;
+	}
+	while (p < end)
+	    *out++ = *p++;
+	*out++ = ' ';
+    }
+    fwrite(buf, 1, out - buf, stdout);
+}
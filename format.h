@@ -0,0 +1,21 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the conversion of numbers to strings.
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "types.h"
+
+// Longest number: 64 binary digits and a sign
+#define FORMAT_SIZE  (8 * sizeof(cell) + 2)
+
+char *format_number(char *end, cell n, cell base, int is_signed);
+void format_cells(cell *v, cell n, cell base);
+
+#endif
@@ -0,0 +1,191 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains hash functions and checksums.
+//
+// `hash_bytes` is wyhash (final version 4) with a fixed seed, so that
+// its values are the same in every run and can be stored in files.
+// They depend on the byte order, however; with 32-bit cells, the words
+// return the low half. `crc32c` uses the CRC32
+// instruction of SSE 4.2 if the processor has it, and tables with
+// eight bytes per step otherwise.
+
+#include "hash.h"
+
+#include <string.h>
+
+// ---------------------------------------------------------------------------
+// wyhash
+
+static const uint64_t secret[4] = {
+    UINT64_C(0x2d358dccaa6c78a5), UINT64_C(0x8bb84b93962eacc9),
+    UINT64_C(0x4b33a62ed433d4a3), UINT64_C(0x4d5a2da51de1aa47),
+};
+
+// The 128-bit product of *a and *b: low half in *a, high half in *b
+static inline void mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)*a * *b;
+
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    // Without a 128-bit type, from four products of 32-bit halves
+    uint64_t ha = *a >> 32, hb = *b >> 32;
+    uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl, lo;
+
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t mix(uint64_t a, uint64_t b)
+{
+    mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t read8(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t read4(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+uint64_t hash_bytes(const void *key, size_t n)
+{
+    const uint8_t *p = key;
+    uint64_t seed = mix(secret[0], secret[1]);
+    uint64_t a, b;
+
+    if (n <= 16) {
+	if (n >= 4) {
+	    a = read4(p) << 32 | read4(p + ((n >> 3) << 2));
+	    b = read4(p + n - 4) << 32 | read4(p + n - 4 - ((n >> 3) << 2));
+	} else if (n > 0) {
+	    a = (uint64_t)p[0] << 16 | (uint64_t)p[n >> 1] << 8 | p[n - 1];
+	    b = 0;
+	} else
+	    a = b = 0;
+    } else {
+	size_t i = n;
+
+	if (i > 48) {
+	    uint64_t seed1 = seed, seed2 = seed;
+
+	    do {
+		seed = mix(read8(p) ^ secret[1], read8(p + 8) ^ seed);
+		seed1 = mix(read8(p + 16) ^ secret[2], read8(p + 24) ^ seed1);
+		seed2 = mix(read8(p + 32) ^ secret[3], read8(p + 40) ^ seed2);
+		p += 48;
+		i -= 48;
+	    } while (i > 48);
+	    seed ^= seed1 ^ seed2;
+	}
+	while (i > 16) {
+	    seed = mix(read8(p) ^ secret[1], read8(p + 8) ^ seed);
+	    i -= 16;
+	    p += 16;
+	}
+	a = read8(p + i - 16);
+	b = read8(p + i - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    mum(&a, &b);
+    return mix(a ^ secret[0] ^ n, b ^ secret[1]);
+}
+
+uint64_t hash_cell(uint64_t x)
+{
+    return mix(x ^ secret[0], secret[1]);
+}
+
+// ---------------------------------------------------------------------------
+// CRC32C
+
+#define CRC32C_POLY  0x82f63b78   // Castagnoli, reflected
+
+static uint32_t crc_table[8][256];
+
+static void crc_init(void)
+{
+    uint32_t i, j, c;
+
+    for (i = 0; i < 256; i++) {
+	c = i;
+	for (j = 0; j < 8; j++)
+	    c = c & 1 ? c >> 1 ^ CRC32C_POLY : c >> 1;
+	crc_table[0][i] = c;
+    }
+    for (i = 0; i < 256; i++)
+	for (j = 1; j < 8; j++)
+	    crc_table[j][i] = crc_table[j - 1][i] >> 8
+		^ crc_table[0][crc_table[j - 1][i] & 0xff];
+}
+
+static uint32_t crc_soft(uint32_t c, const uint8_t *p, size_t n)
+{
+    if (!crc_table[0][1])
+	crc_init();
+    for (; n >= 8; p += 8, n -= 8) {
+	uint64_t v = read8(p) ^ c;
+
+	c = crc_table[7][v & 0xff] ^ crc_table[6][v >> 8 & 0xff]
+	    ^ crc_table[5][v >> 16 & 0xff] ^ crc_table[4][v >> 24 & 0xff]
+	    ^ crc_table[3][v >> 32 & 0xff] ^ crc_table[2][v >> 40 & 0xff]
+	    ^ crc_table[1][v >> 48 & 0xff] ^ crc_table[0][v >> 56];
+    }
+    while (n--)
+	c = c >> 8 ^ crc_table[0][(c ^ *p++) & 0xff];
+    return c;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc_sse42(uint32_t c, const uint8_t *p, size_t n)
+{
+    uint64_t c64 = c;
+
+    for (; n >= 8; p += 8, n -= 8)
+	c64 = __builtin_ia32_crc32di(c64, read8(p));
+    c = (uint32_t)c64;
+    while (n--)
+	c = __builtin_ia32_crc32qi(c, *p++);
+    return c;
+}
+#endif
+
+// CRC32C of *n* bytes at *p*. The result for one block is the seed
+// for the next, so that a stream can be checked in pieces.
+uint32_t crc32c(const void *p, size_t n, uint32_t seed)
+{
+    static uint32_t (*crc)(uint32_t, const uint8_t*, size_t);
+
+    if (!crc) {
+	crc = crc_soft;
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("sse4.2"))
+	    crc = crc_sse42;
+#endif
+    }
+    return ~crc(~seed, p, n);
+}
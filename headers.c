@@ -62,6 +62,7 @@ E(argc, "argc", 0)
 E(argv, "argv", 0)
 E(arg_cmdline, "arg-cmdline", 0)
 E(arg_interactive, "arg-interactive", 0)
+E(arg_server, "arg-server", 0)
 
 // Files
 E(stdin_, "stdin", 0)
@@ -97,9 +98,91 @@ E(lines_close, "lines-close", 0)
 E(lines_get, "lines-get", 0)
 E(lines_i, "lines-i", 0)
 E(lines_iq, "lines-i?", 0)
+E(per_records, "/records", 0)
+E(records_open, "records-open", 0)
+E(records_close, "records-close", 0)
+E(records_slice, "(records-slice)", 0)
+E(records_get, "records-get", 0)
+E(records_i, "records-i", 0)
+E(records_iq, "records-i?", 0)
+E(records_count, "records-count", 0)
 E(errno_, "errno", 0)
 E(do_stream, "do-stream", 0)
 
+// Execution trace
+E(trace_on, "trace-on", 0)
+E(trace_off, "trace-off", 0)
+E(trace_onq, "trace-on?", 0)
+E(trace_dump, "trace-dump", 0)
+
+// Metrics
+E(dot_stats, ".stats", 0)
+E(dot_code_size, ".code-size", 0)
+E(dot_memory, ".memory", 0)
+E(file_bytes, "file-bytes", 0)
+E(file_start, "(file-start)", 0)
+E(file_end, "(file-end)", 0)
+E(abort_start, "(abort-start)", 0)
+E(abort_end, "(abort-end)", 0)
+
+// Cache for compiled files
+E(cache_key, "(cache-key)", 0)
+E(cache_load, "(cache-load)", 0)
+E(cache_mark, "(cache-mark)", 0)
+E(cache_save, "(cache-save)", 0)
+
+// Persistent regions
+E(region_open, "(region-open)", 0)
+E(region_close, "region-close", 0)
+E(region_allot, "region-allot", 0)
+E(region_main, "region-main", 0)
+E(region_commit, "(region-commit)", 0)
+E(region_size, "region-size", 0)
+E(region_base, "region-base", 0)
+
+// Hashing
+E(hash_bytes_, "hash-bytes", 0)
+E(hash_cell_, "hash-cell", 0)
+E(crc32c_, "crc32c", 0)
+
+// Hash maps
+E(hmap_new, "hmap-new", 0)
+E(str_hmap_new, "str-hmap-new", 0)
+E(hmap_free, "hmap-free", 0)
+E(hmap_put, "hmap-put", 0)
+E(hmap_get, "hmap-get", 0)
+E(hmap_del, "hmap-del", 0)
+E(hmap_count, "hmap-count", 0)
+E(hmap_next, "hmap-next", 0)
+E(hmap_entry, "hmap-entry", 0)
+
+// Sorting
+E(sort_cells, "sort-cells", 0)
+E(usort_cells, "usort-cells", 0)
+E(sort_records, "sort-records", 0)
+E(sort_by, "sort-by", 0)
+E(sort_step, "(sort-step)", 0)
+
+// Processes and channels
+E(fork_, "fork", 0)
+E(exit_process, "exit-process", 0)
+E(wait_pid, "wait-pid", 0)
+E(server_open, "server-open", 0)
+E(server_fork, "server-fork", 0)
+E(chan_new, "chan-new", 0)
+E(chan_free, "chan-free", 0)
+E(chan_close, "chan-close", 0)
+E(chan_spin, "chan-spin", 0)
+E(chan_send, "chan-send", 0)
+E(chan_recv, "chan-recv", 0)
+E(chan_send_n, "chan-send-n", 0)
+E(chan_recv_n, "chan-recv-n", 0)
+E(per_chanstream, "/chanstream", 0)
+E(chanstream_open, "chanstream-open", 0)
+E(chanstream_get, "chanstream-get", 0)
+E(chanstream_i, "chanstream-i", 0)
+E(chanstream_iq, "chanstream-i?", 0)
+
 // Dictionary
 E(last, "last",0)
 E(dp, "dp",0)
@@ -120,11 +203,43 @@ E(to_name, ">name", 0)
 E(to_doer, ">doer", 0)
 E(to_body, ">body", 0)
 E(num_immediate, "#immediate", 0)
+E(num_fixed, "#fixed", 0)
+E(num_inline, "#inline", 0)
+E(seal, "seal", 0)
+E(unseal_, "unseal", 0)
+E(sealedq, "sealed?", 0)
+E(literal_comma, "literal,", 0)
+E(if_comma, "if,", 0)
+E(case_comma, "case,", 0)
+E(of_comma, "of,", 0)
+E(endof_comma, "endof,", 0)
+E(endcase_comma, "endcase,", 0)
+E(marker_, "(marker)", 0)
+E(forget_marker, "(forget-marker)", 0)
+E(forget_, "(forget)", 0)
+E(qinline, "?inline", 0)
+E(qtokens, "?tokens", 0)
+E(qtail, "?tail", 0)
+E(tail_comma, "tail,", 0)
 
 // Inline constants
 E(branch, "branch", 0)
 E(zbranch, "0branch", 0)
 E(lit, "lit", 0)
+E(tail_call, "tail-call", 0)
+E(jump_table, "jump-table", 0)
+E(case_search, "case-search", 0)
+E(of_, "(of)", 0)
+
+// Counted loops
+E(do_, "(do)", 0)
+E(qdo, "(?do)", 0)
+E(loop_, "(loop)", 0)
+E(plus_loop, "(+loop)", 0)
+E(loop_i, "I", 0)
+E(loop_j, "J", 0)
+E(leave, "LEAVE", 0)
+E(unloop, "UNLOOP", 0)
 
 // Return stack
 E(rdrop, "rdrop", 0)
@@ -137,6 +252,19 @@ E(r0, "r0",0)
 E(rpfetch, "rp@", 0)
 E(rpstore, "rp!", 0)
 
+// Local variables
+E(locals_, "(locals)", 0)
+E(local_fetch, "local@", 0)
+E(local_store, "local!", 0)
+E(exit_locals, "(exit-locals)", 0)
+E(unlocals, "(unlocals)", 0)
+E(drop_locals, "(drop-locals)", 0)
+E(local_name, "(local-name)", 0)
+E(local_, "(local)", 0)
+E(num_locals, "#locals", 0)
+E(locals_start, "(locals-start)", 0)
+E(end_locals, "(end-locals)", 0)
+
 // Stack
 E(nip, "nip", 0)
 E(drop, "drop", 0)
@@ -154,44 +282,44 @@ E(spfetch, "sp@", 0)
 E(spstore, "sp!", 0)
 
 // Arithmetics
-E(false, "false", 0)
-E(true, "true", 0)
-E(zero, "0", 0)
-E(one, "1", 0)
-E(minus_one, "-1", 0)
-E(two, "2", 0)
-E(oneplus, "1+", 0)
-E(oneminus, "1-", 0)
-E(twotimes, "2*", 0)
-E(twodiv, "2/", 0)
-E(minus, "-", 0)
-E(plus, "+", 0)
-E(times, "*", 0)
-E(divide, "/", 0)
-E(mod, "mod", 0)
-E(udivide, "u/", 0)
-E(abs, "abs", 0)
-E(negate, "negate", 0)
-E(or, "or", 0)
-E(and, "and", 0)
-E(xor, "xor", 0)
-E(not, "not", 0)
+E(false, "false", FOLDS(0))
+E(true, "true", FOLDS(0))
+E(zero, "0", FOLDS(0))
+E(one, "1", FOLDS(0))
+E(minus_one, "-1", FOLDS(0))
+E(two, "2", FOLDS(0))
+E(oneplus, "1+", FOLDS(1))
+E(oneminus, "1-", FOLDS(1))
+E(twotimes, "2*", FOLDS(1))
+E(twodiv, "2/", FOLDS(1))
+E(minus, "-", FOLDS(2))
+E(plus, "+", FOLDS(2))
+E(times, "*", FOLDS(2))
+E(divide, "/", FOLDS(2))
+E(mod, "mod", FOLDS(2))
+E(udivide, "u/", FOLDS(2))
+E(abs, "abs", FOLDS(1))
+E(negate, "negate", FOLDS(1))
+E(or, "or", FOLDS(2))
+E(and, "and", FOLDS(2))
+E(xor, "xor", FOLDS(2))
+E(not, "not", FOLDS(1))
 E(divmod, "/mod", 0)
 E(udivmod, "u/mod", 0)
-E(equal, "=", 0)
-E(unequal, "<>", 0)
-E(zero_equal, "0=", 0)
-E(zero_unequal, "0<>", 0)
-E(zero_less, "0<", 0)
-E(zero_greater, "0>", 0)
-E(less, "<", 0)
-E(less_eq, "<=", 0)
-E(greater, ">", 0)
-E(greater_eq, ">=", 0)
-E(uless, "u<", 0)
-E(uless_eq, "u<=", 0)
-E(ugreater, "u>", 0)
-E(ugreater_eq, "u>=", 0)
+E(equal, "=", FOLDS(2))
+E(unequal, "<>", FOLDS(2))
+E(zero_equal, "0=", FOLDS(1))
+E(zero_unequal, "0<>", FOLDS(1))
+E(zero_less, "0<", FOLDS(1))
+E(zero_greater, "0>", FOLDS(1))
+E(less, "<", FOLDS(2))
+E(less_eq, "<=", FOLDS(2))
+E(greater, ">", FOLDS(2))
+E(greater_eq, ">=", FOLDS(2))
+E(uless, "u<", FOLDS(2))
+E(uless_eq, "u<=", FOLDS(2))
+E(ugreater, "u>", FOLDS(2))
+E(ugreater_eq, "u>=", FOLDS(2))
 E(within, "within", 0)
 
 // Memory
@@ -205,12 +333,14 @@ E(cmove, "cmove", 0)
 E(fill, "fill", 0)
 E(malloc, "malloc", 0)
 E(free, "free", 0)
-E(per_cell, "/cell", 0)
+E(free_at_marker, "free-at-marker", 0)
+E(per_cell, "/cell", FOLDS(0))
 E(cellplus, "cell+", 0)
 E(cellminus, "cell-", 0)
 
 E(strlen, "strlen", 0)
 E(strchr, "strchr", 0)
+E(str_equal, "str=", 0)
 
 // Input/Output
 E(emit, "emit", 0)
@@ -218,12 +348,24 @@ E(type, "type", 0)
 E(gets, "gets", 0)
 E(puts, "puts", 0)
 E(cr, "cr", 0)
+E(base, "base", 0)
+E(udot_paren, "(u.)", 0)
+E(dot_paren, "(.)", 0)
+E(dot_cells, ".cells", 0)
 E(uhdot, "uh.", 0)
 E(bl, "bl", 0)
 E(num_eol, "#eol", 0)
 E(num_eof, "#eof", 0)
 E(whitespace, "whitespace", 0)
 
+// C interface
+E(library, "library", 0)
+E(c_symbol, "c-symbol", 0)
+E(c_stub, "c-stub", 0)
+
+// Compiler to C
+E(compile_to_c, "(compile-to-c)", 0)
+
 // Others
 E(dotparen, ".(", 0)
 
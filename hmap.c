@@ -0,0 +1,248 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains hash maps with cell or string keys.
+//
+// A map is a flat array of slots with open addressing and Robin
+// Hood probing: a key that is further away from its home slot takes
+// the place of one that is nearer to its own. The probe sequences stay
+// short, and a search can stop at the first key that is nearer to its
+// home than the searched key would be.
+//
+// When the map is full, a table with twice the size is allocated, and
+// every later change moves a few slots of the old table into it, so
+// that no single change has to move all keys. A key is either in the
+// new table or in the old one; slots of the old table that are moved
+// or deleted become tombstones.
+
+#include "hmap.h"
+
+#include <string.h>
+
+#define HASH_USED  ((ucell)1 << (sizeof(cell) * 8 - 1))
+#define HASH_TOMB  (HASH_USED >> 1)
+#define MOVE_STEP  16           // Slots moved at each change
+#define MIN_SLOTS  16
+
+// The hash is computed with 64 bits whatever the size of a cell, and
+// only reduced to a cell at the end.
+static cell hash_key(hmap_t *m, cell key)
+{
+    uint64_t h;
+
+    if (m->strings) {
+	const unsigned char *s = (const unsigned char*)key;
+
+	for (h = UINT64_C(0xcbf29ce484222325); *s; s++)
+	    h = (h ^ *s) * UINT64_C(0x100000001b3);
+    } else
+	h = (ucell)key;
+    // Mix the bits, so that the lowest bits depend on all of them
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    return ((ucell)h & ~HASH_TOMB) | HASH_USED;
+}
+
+static int same_key(hmap_t *m, hslot_t *s, cell hash, cell key)
+{
+    return s->hash == hash
+	&& (m->strings ? !strcmp((char*)s->key, (char*)key) : s->key == key);
+}
+
+// Distance of the key in slot *i* from its home slot
+#define DIST(t, mask, i)  (((i) - (t)[i].hash) & (mask))
+
+static hslot_t *find_new(hmap_t *m, cell hash, cell key)
+{
+    cell i = hash & m->mask, d;
+
+    for (d = 0; m->slots[i].hash; d++, i = (i + 1) & m->mask) {
+	if (DIST(m->slots, m->mask, i) < d)
+	    return NULL;
+	if (same_key(m, &m->slots[i], hash, key))
+	    return &m->slots[i];
+    }
+    return NULL;
+}
+
+// The old table may contain tombstones, so that the distances are not
+// reliable; it is searched up to the next empty slot.
+static hslot_t *find_old(hmap_t *m, cell hash, cell key)
+{
+    cell i;
+
+    if (!m->old)
+	return NULL;
+    for (i = hash & m->old_mask; m->old[i].hash; i = (i + 1) & m->old_mask)
+	if (same_key(m, &m->old[i], hash, key))
+	    return &m->old[i];
+    return NULL;
+}
+
+static void insert(hmap_t *m, hslot_t s)
+{
+    cell i = s.hash & m->mask, d;
+
+    for (d = 0; m->slots[i].hash; d++, i = (i + 1) & m->mask) {
+	cell di = DIST(m->slots, m->mask, i);
+
+	if (di < d) {
+	    hslot_t tmp = m->slots[i];
+
+	    m->slots[i] = s;
+	    s = tmp;
+	    d = di;
+	}
+    }
+    m->slots[i] = s;
+}
+
+// Move some slots from the old table to the new one.
+static void move_step(hmap_t *m)
+{
+    cell end;
+
+    if (!m->old)
+	return;
+    end = m->moved + MOVE_STEP;
+    for (; m->moved < end && m->moved <= m->old_mask; m->moved++) {
+	hslot_t *s = &m->old[m->moved];
+
+	if (s->hash && !(s->hash & HASH_TOMB)) {
+	    insert(m, *s);
+	    s->hash |= HASH_TOMB;
+	}
+    }
+    if (m->moved > m->old_mask) {
+	free(m->old);
+	m->old = NULL;
+    }
+}
+
+static void grow(hmap_t *m)
+{
+    m->old = m->slots;
+    m->old_mask = m->mask;
+    m->moved = 0;
+    m->mask = 2 * m->mask + 1;
+    m->slots = calloc(m->mask + 1, sizeof(hslot_t));
+}
+
+hmap_t *hmap_new(cell strings)
+{
+    hmap_t *m = calloc(1, sizeof(hmap_t));
+
+    m->mask = MIN_SLOTS - 1;
+    m->slots = calloc(MIN_SLOTS, sizeof(hslot_t));
+    m->strings = strings;
+    return m;
+}
+
+void hmap_free(hmap_t *m)
+{
+    cell i;
+
+    if (m->strings) {
+	for (i = 0; i <= m->mask; i++)
+	    if (m->slots[i].hash)
+		free((char*)m->slots[i].key);
+	for (i = 0; m->old && i <= m->old_mask; i++)
+	    if (m->old[i].hash && !(m->old[i].hash & HASH_TOMB))
+		free((char*)m->old[i].key);
+    }
+    free(m->old);
+    free(m->slots);
+    free(m);
+}
+
+// Address of the value for *key*, or NULL. It is valid until the
+// next change of the map.
+cell *hmap_get(hmap_t *m, cell key)
+{
+    cell hash = hash_key(m, key);
+    hslot_t *s = find_new(m, hash, key);
+
+    if (!s)
+	s = find_old(m, hash, key);
+    return s ? &s->value : NULL;
+}
+
+void hmap_put(hmap_t *m, cell key, cell value)
+{
+    cell hash = hash_key(m, key);
+    hslot_t *s;
+
+    move_step(m);
+    if ((s = find_new(m, hash, key))) {
+	s->value = value;
+	return;
+    }
+    if ((s = find_old(m, hash, key))) {
+	// Move the key into the new table
+	s->hash |= HASH_TOMB;
+	insert(m, (hslot_t) { hash, s->key, value });
+	return;
+    }
+
+    if (!m->old && (m->count + 1) * 8 > (m->mask + 1) * 7)
+	grow(m);
+    if (m->strings)
+	key = (cell)strdup((char*)key);
+    insert(m, (hslot_t) { hash, key, value });
+    m->count++;
+}
+
+void hmap_del(hmap_t *m, cell key)
+{
+    cell hash = hash_key(m, key);
+    hslot_t *s;
+
+    move_step(m);
+    if ((s = find_new(m, hash, key))) {
+	// Shift the following keys back, to keep the probes short
+	cell i = s - m->slots, j;
+
+	key = s->key;
+	for (;; i = j) {
+	    j = (i + 1) & m->mask;
+	    if (!m->slots[j].hash || !DIST(m->slots, m->mask, j))
+		break;
+	    m->slots[i] = m->slots[j];
+	}
+	m->slots[i].hash = 0;
+    } else if ((s = find_old(m, hash, key))) {
+	key = s->key;
+	s->hash |= HASH_TOMB;
+    } else
+	return;
+
+    if (m->strings)
+	free((char*)key);
+    m->count--;
+}
+
+// Slot number *i* counts first through the new and then through the
+// old table.
+hslot_t *hmap_slot(hmap_t *m, cell i)
+{
+    return i <= m->mask ? &m->slots[i] : &m->old[i - m->mask - 1];
+}
+
+// The first used slot from slot number *i* on, or -1.
+cell hmap_next(hmap_t *m, cell i)
+{
+    cell end = m->mask + 1 + (m->old ? m->old_mask + 1 : 0);
+
+    for (; i < end; i++) {
+	cell hash = hmap_slot(m, i)->hash;
+
+	if (hash && !(hash & HASH_TOMB))
+	    return i;
+    }
+    return -1;
+}
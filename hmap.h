@@ -0,0 +1,42 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains hash maps with cell or string keys.
+
+#ifndef HMAP_H
+#define HMAP_H
+
+#include "types.h"
+
+typedef struct {
+    cell hash;                  // 0 if the slot is empty
+    cell key;
+    cell value;
+} hslot_t;
+
+typedef struct {
+    hslot_t *slots;
+    cell mask;                  // Number of slots - 1
+    cell count;                 // Number of keys in both tables
+    cell strings;               // flag: the keys are strings
+
+    // While the map grows, the keys are moved step by step from the
+    // old table to the new one.
+    hslot_t *old;               // Old table, or NULL
+    cell old_mask;
+    cell moved;                 // Number of slots of `old` done
+} hmap_t;
+
+hmap_t *hmap_new(cell strings);
+void hmap_free(hmap_t *m);
+cell *hmap_get(hmap_t *m, cell key);
+void hmap_put(hmap_t *m, cell key, cell value);
+void hmap_del(hmap_t *m, cell key);
+cell hmap_next(hmap_t *m, cell i);
+hslot_t *hmap_slot(hmap_t *m, cell i);
+
+#endif
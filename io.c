@@ -6,18 +6,25 @@
 // the file "copying" for details.
 
 #include "io.h"
+#include "stats.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // Interpret FILENAME relative to the directory of MIND_FILE.
 char *mind_relative(char* mind_file, char *filename)
 {
     char mind_dir[PATH_MAX];
     char *slash = strrchr(mind_file, '/');
-    if (slash)
+    if (slash) {
 	strncpy(mind_dir, mind_file, slash - mind_file);
+	mind_dir[slash - mind_file] = '\0';
+    }
     else
 	strcpy(mind_dir, mind_file);
 
@@ -32,6 +39,8 @@ void file_open(textfile_t *inf, char* name)
     if ((inf->input = (cell)fopen(name, "r"))) {
         errno = 0;
 	inf->current = fgetc((FILE*)inf->input);
+        if (inf->current != EOF)
+            stats.read_bytes++;
     }
 }
 
@@ -48,6 +57,8 @@ void file_get(textfile_t *inf)
 {
     inf->current = fgetc((FILE*)inf->input);
 
+    if (inf->current != EOF)
+        stats.read_bytes++;
     if (inf->current == '\n')
 	inf->lineno++;
     else if (inf->current == EOF)
@@ -83,10 +94,74 @@ void lines_get(lines_t *seq)
 {
     char *lineptr = (char*)seq->line;
     size_t len;
+    ssize_t n;
 
-    if (getline(&lineptr, &len, (FILE*)seq->file) != -1) {
+    if ((n = getline(&lineptr, &len, (FILE*)seq->file)) != -1) {
+        stats.read_bytes += n;
         seq->line = (cell)lineptr;
         seq->lineno++;
     } else
         lines_close(seq);
 }
+
+// Map the file *path* for reading and divide it into records of
+// *size* bytes. A partial record at the end of the file is ignored.
+void records_open(records_t *rec, char *path, cell size)
+{
+    struct stat st;
+    void *base = NULL;
+    int fd;
+
+    rec->base = rec->length = rec->current = rec->end = 0;
+    rec->size = size;
+    rec->owner = 0;
+    if (size <= 0) {
+        errno = EINVAL;
+        return;
+    }
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return;
+    if (fstat(fd, &st) < 0)
+        goto done;
+    if (st.st_size > 0) {
+        base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED)
+            goto done;
+        madvise(base, st.st_size, MADV_SEQUENTIAL);
+    }
+
+    rec->base = rec->current = (cell)base;
+    rec->length = st.st_size;
+    rec->end = rec->base + st.st_size / size * size;
+    rec->owner = 1;
+    errno = 0;                  // Reset errno if no error occured
+done:
+    close(fd);
+}
+
+void records_close(records_t *rec)
+{
+    if (rec->owner && rec->base && !munmap((void*)rec->base, rec->length))
+        errno = 0;              // Reset errno if no error occured
+
+    rec->base = rec->length = rec->current = rec->end = 0;
+    rec->owner = 0;
+}
+
+// Make *to* a stream over part *k* of *n* equal parts of the remaining
+// records of *from*. The parts are disjoint and together contain all
+// records; *to* shares the mapping of *from*, which must stay open.
+// Returns 0 if *from* is not open or *k* is not in 0..n-1.
+int records_slice(records_t *from, records_t *to, cell k, cell n)
+{
+    cell count;
+
+    if (!from->base || k < 0 || k >= n)
+	return 0;
+    count = (from->end - from->current) / from->size;
+    *to = *from;
+    to->current = from->current + count * k / n * from->size;
+    to->end = from->current + count * (k + 1) / n * from->size;
+    to->owner = 0;
+    return 1;
+}
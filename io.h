@@ -33,6 +33,17 @@ typedef struct {
     cell lineno;		// integer: line number
 } lines_t;
 
+// Structure to iterate over the fixed-size records of a mapped file.
+typedef struct {
+    stream_t stream;
+    cell base;                  // (char*) Start of the mapping, or NULL
+    cell length;                // Length of the mapping in bytes
+    cell size;                  // Size of a record in bytes
+    cell current;               // (char*) Record at input position
+    cell end;                   // (char*) End of the records of the stream
+    cell owner;                 // flag: the stream must unmap the file
+} records_t;
+
 char *mind_relative(char *mind_file, char *filename);
 
 void file_open(textfile_t *inf, char* name);
@@ -43,4 +54,8 @@ void lines_open(lines_t *seq, char* path);
 void lines_close(lines_t *seq);
 void lines_get(lines_t *seq);
 
+void records_open(records_t *rec, char *path, cell size);
+void records_close(records_t *rec);
+int records_slice(records_t *from, records_t *to, cell k, cell n);
+
 #endif
@@ -13,9 +13,23 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <dlfcn.h>
+#include <sys/wait.h>
 
+#include "aot.h"
 #include "args.h"
+#include "cache.h"
+#include "chan.h"
+#include "dict.h"
+#include "format.h"
+#include "hash.h"
+#include "hmap.h"
 #include "io.h"
+#include "region.h"
+#include "sort.h"
+#include "stats.h"
+#include "server.h"
+#include "trace.h"
 
 #define MEMCELLS 0x10000	// Number of cells in the main memory
 #define RCELLS   0x100          // Number of cells in the return stack
@@ -43,20 +57,6 @@ enum wordnum_t {
 #undef E
     num_words };
 
-/* Interpreter flags */
-#define IMMEDIATE 1
-
-typedef void *label_t;		/* Target of computed goto. */
-
-typedef struct {
-    cell link;      // (entry*)  Pointer to previous entry.
-    cell name;      // (char*)   Pointer to start of word name.
-    char flags;
-    cell xt;        // (label_t) C code that executes this word.
-    cell doer;      // (cell*)   Forth routine for `does>` part.
-    cell body[];
-} entry_t;
-
 #define NEW_WORD(label, wname, wflags)				\
 {   .link  = i_##label ? (cell)&dict[i_##label - 1] : 0,	\
     .flags = wflags,						\
@@ -71,21 +71,38 @@ typedef struct {
     .xt    = (cell)&&dodefer,					\
     .doer  = C(wdoer) },
 
-// Compute the address of an entry_t field when given an execution
-// token instead of the beginning of the struct.
-#define FROM_XT(addr)                                     \
-    ((entry_t*)((char*)(addr) - offsetof(entry_t, xt)))
+/* Length and hash of *name*, in the format of the flags cell. */
+static cell name_key(char *name)
+{
+    ucell h = 2166136261u;     // FNV-1a
+    size_t n;
+
+    for (n = 0; name[n]; n++)
+	h = (h ^ (unsigned char)name[n]) * 16777619u;
+    return (cell)(((h << 8 | (n & 0xff)) << 8) & ~(ucell)FLAG_MASK);
+}
 
 /* Find XT for *name* in dictionary, starting at *e*. */
 static cell* find_xt(entry_t *e, char *name)
 {
+    cell key = name_key(name);
+
     for (; e; e = (entry_t*)e->link) {
-	if (!strcmp((char*)e->name, name))
+	if ((e->flags & ~FLAG_MASK) == key && !strcmp((char*)e->name, name))
 	    return &e->xt;
     }
     return NULL;
 }
 
+// Count a dictionary search for *name* with the result *xt*.
+static cell *count_find(cell *xt, char *name)
+{
+    stats.finds++;
+    stats.find_hits += xt != NULL;
+    stats.parsed_bytes += strlen(name);
+    return xt;
+}
+
 typedef struct {
     cell link;                  // (context_t*) Previous context in chain
     cell last;                  // (entry_t*)   The last definition
@@ -102,6 +119,27 @@ typedef struct {
 
 #define C(label)  ((cell)(&dict[i_##label].xt)) // Call to Forth word
 
+// C labels of the dictionary entries, for the compiler to C
+static const char *word_labels[] = {
+#define E(label, ...)  #label,
+#define D E
+#include "headers.c"
+#undef D
+#undef E
+};
+
+// Code generated by `compile-to-c`: call a word and continue at the
+// label *resume*. See aot.c for details.
+#define AOT_RESUME(resume)						\
+    static cell r[] = { (cell)&r[1], (cell)&&resume }; ip = r
+#define AOT_PRIM(label, resume)  { AOT_RESUME(resume); goto label; }
+#define AOT_COLON(label, resume) { AOT_RESUME(resume); goto label; }
+#define AOT_CALL(xt, resume)						\
+    { AOT_RESUME(resume); w = (label_t*)(xt); goto **w; }
+#define AOT_EXIT                 { ip = (cell*)RPOP; goto next; }
+#define AOT_TAIL(xt)							\
+    { w = (label_t*)(xt); ip = FROM_XT(w)->body; goto next; }
+
 // ---------------------------------------------------------------------------
 // System variables
 
@@ -113,7 +151,9 @@ struct {
     cell dp;		     // (cell*) Dictionary pointer
     cell s0;		     // (cell*) Start of the parameter stack
     cell state;		     // Compiler state
+    cell base;               // Base for number conversion
     cell wordq;		     // Called if word not found
+    cell last_call;          // (cell*) Last call compiled by exec/compile
     context_t root;          // root context
     textfile_t textfile0;    // Prototype for text streams
     textfile_t inf;	     // Input file
@@ -138,12 +178,17 @@ static void file_init(textfile_t *inf, entry_t dict[])
 
 static void init_sys(entry_t dict[])
 {
+    cell i;
+
+    for (i = 0; i < num_words; i++)
+	dict[i].flags |= name_key((char*)dict[i].name);
     sys.r0 = (cell)(sys.rstack + RCELLS);
     sys.op0 = (cell)(sys.ostack + OREFS - 0x10);
     sys.op = sys.op0;
     sys.dp = (cell)sys.mem;
     sys.s0 = (cell)(sys.mem + MEMCELLS - 0x10); // Top of memory + safety space
     sys.state = 0;
+    sys.base = 10;
     sys.wordq = C(notfound);
     sys.root.link = 0;
     sys.root.last = (cell)&dict[num_words - 1];
@@ -181,6 +226,10 @@ static void init_sys(entry_t dict[])
 #define FUNC1(x)  TOS = (cell)(x); goto next            // ( n1 -- n2 )
 #define FUNC2(x)  NOS = (cell)(x); DROP(1); goto next   // ( n1 n2 -- n3 )
 
+// Macros for words with *n* parameters and 1 or 0 results
+#define FUNCN(n, x)  { cell res = (cell)(x); DROP((n) - 1); TOS = res; goto next; }
+#define PROCN(n, x)  x; DROP(n); goto next
+
 // Some functions must return a Forth-style boolean.
 #define BOOL(n)	((n) ? TRUE : FALSE)
 
@@ -203,6 +252,1079 @@ static cell aligned(cell addr, cell align)
 #define COMMA(val, type) \
     ALIGN(type), *(type*)sys.dp = (type)(val), sys.dp += sizeof(type)
 
+/* ---------------------------------------------------------------------- */
+/* Sealed Defer words */
+
+// A call to a sealed Defer word that was replaced by a call to its
+// target. `is` restores it.
+typedef struct {
+    cell *site;                 // Address of the call
+    cell defer;                 // XT of the Defer word
+} seal_site_t;
+
+static struct {
+    seal_site_t *sites;
+    cell count, size;
+    hmap_t *at;                 // The addresses in `sites`
+} sealed;
+
+static void seal_record(cell *site, cell defer)
+{
+    if (sealed.count == sealed.size) {
+	sealed.size = sealed.size ? 2 * sealed.size : 64;
+	sealed.sites = realloc(sealed.sites, sealed.size * sizeof(seal_site_t));
+	if (!sealed.at)
+	    sealed.at = hmap_new(0);
+    }
+    sealed.sites[sealed.count++] = (seal_site_t) { site, defer };
+    hmap_put(sealed.at, (cell)site, 1);
+}
+
+// Forget the site with the index *i*.
+static void seal_remove(cell i)
+{
+    hmap_del(sealed.at, (cell)sealed.sites[i].site);
+    sealed.sites[i] = sealed.sites[--sealed.count];
+}
+
+// Is *site* a call that `is` may have to restore?
+static int seal_recorded(cell *site)
+{
+    return sealed.count && hmap_get(sealed.at, (cell)site);
+}
+
+// Is there such a call between *start* and *end*?
+static int seal_within(cell start, cell end)
+{
+    cell i;
+
+    for (i = 0; i < sealed.count; i++)
+	if ((cell)sealed.sites[i].site >= start
+	    && (cell)sealed.sites[i].site < end)
+	    return 1;
+    return 0;
+}
+
+// Make *e* an ordinary Defer word again. The calls that were replaced
+// by a jump with `tail-call` become a call and `;;`.
+static void unseal(entry_t *e, entry_t dict[])
+{
+    cell i = 0;
+
+    if (!(e->flags & SEALED))
+	return;
+    e->flags &= ~SEALED;
+    while (i < sealed.count) {
+	seal_site_t *s = &sealed.sites[i];
+
+	if (s->defer != (cell)&e->xt) {
+	    i++;
+	    continue;
+	}
+	if (*s->site == e->doer)
+	    *s->site = s->defer;
+	else if (*s->site == C(tail_call) && s->site[1] == e->doer) {
+	    s->site[0] = s->defer;
+	    s->site[1] = C(semi);
+	}
+	seal_remove(i);
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+/* Inlining */
+
+// Maximal number of cells in a word that is inlined automatically
+#define INLINE_CELLS 8
+
+// Maximal nesting of does> words whose code is checked for inlining
+#define INLINE_NESTING 4
+
+// Runtimes of the words whose calls can be replaced by code
+static struct {
+    cell docol, dovar, dodoes, dodefer;
+    cell dotok;                 // Colon definitions in tokens, see TOKENS
+} runtime;
+
+static int in_kernel(cell xt, entry_t dict[])
+{
+    return xt >= (cell)dict && xt < (cell)(dict + num_words);
+}
+
+// Is *e* a colon definition, in threaded code or in tokens?
+static int colon_word(entry_t *e)
+{
+#ifdef TOKENS
+    if (e->xt == runtime.dotok)
+	return 1;
+#endif
+    return e->xt == runtime.docol;
+}
+
+// Does *xt* take the next cell in the code as its operand?
+static int has_operand(cell xt, entry_t dict[])
+{
+    return xt == C(lit) || xt == C(branch) || xt == C(zbranch)
+	|| xt == C(tail_call) || xt == C(locals_)
+	|| xt == C(local_fetch) || xt == C(local_store)
+	|| xt == C(jump_table) || xt == C(case_search) || xt == C(of_)
+	|| xt == C(do_) || xt == C(qdo) || xt == C(loop_) || xt == C(plus_loop);
+}
+
+// Address of the `;;` that ends *code*, or NULL if there is none
+// before the end of the dictionary.
+static cell *code_end(cell *code, entry_t dict[])
+{
+    for (; code < (cell*)sys.dp; code++) {
+	if (*code == C(semi))
+	    return code;
+	if (has_operand(*code, dict))
+	    code++;
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Code size
+
+// Size of the colon definitions in the dictionary, compared with an
+// encoding in which every reference is a 16- or 32-bit index into a
+// table of XTs. Literals that do not fit into a token and branch
+// offsets that do not fit need an escape token and the full value;
+// cells that are no reference, like inline strings, keep their size.
+typedef struct {
+    cell words;                 // Colon definitions
+    cell cells;                 // Cells in their bodies
+    cell refs;                  // References to words
+    cell table;                 // Entries in the table of XTs
+    cell bytes16, bytes32;      // Size in the token encodings
+    cell token_words;           // Definitions in tokens, see TOKENS
+    cell token_bytes;           // Their size
+} code_size_t;
+
+// Bytes for an operand *x* with tokens of *bits* bits
+static cell token_operand(cell x, int bits)
+{
+    cell limit = (cell)1 << (bits - 1);
+
+    if (x >= -limit && x < limit)
+	return bits / 8;
+    return bits / 8 + (x == (int32_t)x ? 4 : sizeof(cell));
+}
+
+static int is_address_operand(cell xt, entry_t dict[])
+{
+    return xt == C(branch) || xt == C(zbranch) || xt == C(of_)
+	|| xt == C(jump_table) || xt == C(case_search)
+	|| xt == C(do_) || xt == C(qdo) || xt == C(loop_) || xt == C(plus_loop);
+}
+
+static void code_size(code_size_t *size, entry_t dict[])
+{
+    hmap_t *xts = hmap_new(FALSE);
+    entry_t *p, *newer = NULL;
+    cell *c, *end, i;
+
+    *size = (code_size_t) { 0 };
+    for (i = 0; i < num_words; i++)
+	hmap_put(xts, (cell)&dict[i].xt, 1);
+    for (p = (entry_t*)sys.root.last; p && !in_kernel((cell)p, dict);
+	 p = (entry_t*)p->link)
+	hmap_put(xts, (cell)&p->xt, 1);
+    size->table = xts->count;
+
+    for (p = (entry_t*)sys.root.last; p && !in_kernel((cell)p, dict);
+	 newer = p, p = (entry_t*)p->link) {
+	end = newer ? (cell*)newer : (cell*)sys.dp;
+	if (colon_word(p) && p->xt != runtime.docol) {
+	    size->token_words++;
+	    size->token_bytes += (cell)end - (cell)p->body;
+	}
+	if (p->xt != runtime.docol)
+	    continue;
+	size->words++;
+	for (c = p->body; c < end; c++) {
+	    if (!hmap_get(xts, *c)) {
+		size->bytes16 += sizeof(cell);
+		size->bytes32 += sizeof(cell);
+		continue;
+	    }
+	    size->refs++;
+	    size->bytes16 += 2;
+	    size->bytes32 += 4;
+	    if (has_operand(*c, dict) && c + 1 < end) {
+		cell x = c[1];
+
+		if (is_address_operand(*c, dict))
+		    x = (x - (cell)c) / (cell)sizeof(cell);
+		else if (*c == C(tail_call))
+		    x = 0;
+		size->bytes16 += token_operand(x, 16);
+		size->bytes32 += token_operand(x, 32);
+		c++;
+	    }
+	}
+	size->cells += end - p->body;
+    }
+    hmap_free(xts);
+}
+
+// ---------------------------------------------------------------------------
+// Markers
+
+// The state of the dictionary when a marker was created, and the
+// memory that is freed when it is executed.
+typedef struct marker_s {
+    struct marker_s *prev;      // Older marker
+    cell dp;                    // Dictionary pointer
+    cell last;                  // (entry_t*) Newest entry
+    cell *doers;                // Actions of the kernel words
+    void **allocs;              // Memory registered with the marker
+    cell count, size;
+} marker_t;
+
+static marker_t *markers;       // Newest marker
+
+static marker_t *marker_new(entry_t dict[])
+{
+    marker_t *m = calloc(1, sizeof(marker_t));
+    cell i;
+
+    m->prev = markers;
+    m->dp = sys.dp;
+    m->last = sys.root.last;
+    m->doers = malloc(num_words * sizeof(cell));
+    for (i = 0; i < num_words; i++)
+	m->doers[i] = dict[i].doer;
+    return markers = m;
+}
+
+// Free *addr* when the newest marker is executed. Returns false if
+// there is no marker.
+static int marker_register(void *addr)
+{
+    marker_t *m = markers;
+
+    if (!m)
+	return 0;
+    if (m->count == m->size) {
+	m->size = m->size ? 2 * m->size : 16;
+	m->allocs = realloc(m->allocs, m->size * sizeof(void*));
+    }
+    m->allocs[m->count++] = addr;
+    return 1;
+}
+
+// Remove everything that was added to the dictionary since *dp*;
+// *last* becomes the newest entry. The markers that are removed free
+// their memory, and the oldest of them restores the kernel Defer
+// words. Sealed calls in the removed code are forgotten, Defer
+// words whose target was removed are unsealed and reset to
+// `no-defer`, and the files no longer own the removed space.
+static void forget(cell dp, cell last, entry_t dict[])
+{
+    cell old_dp = sys.dp;
+    cell *no_defer = find_xt((entry_t*)last, "no-defer");
+    entry_t *e;
+    cell i;
+
+    while (markers && markers->dp >= dp) {
+	marker_t *m = markers;
+
+	markers = m->prev;
+	for (i = 0; i < m->count; i++)
+	    stats_free(m->allocs[i]);
+	for (i = 0; i < num_words; i++)
+	    if (dict[i].doer != m->doers[i]) {
+		unseal(&dict[i], dict);
+		dict[i].doer = m->doers[i];
+	    }
+	free(m->allocs);
+	free(m->doers);
+	free(m);
+    }
+
+    for (i = 0; i < sealed.count; )
+	if ((cell)sealed.sites[i].site >= dp
+	    && (cell)sealed.sites[i].site < old_dp)
+	    seal_remove(i);
+	else
+	    i++;
+    for (e = (entry_t*)last; e && !in_kernel((cell)e, dict);
+	 e = (entry_t*)e->link)
+	if (e->doer >= dp && e->doer < old_dp) {
+	    unseal(e, dict);
+	    if (e->xt == runtime.dodefer && no_defer)
+		e->doer = (cell)no_defer;
+	}
+
+    stats_file_forget(dp);
+    sys.dp = dp;
+    sys.root.last = last;
+    sys.last_call = 0;
+}
+
+// Return stack frames that the word *xt* uses, see RDEPTH_MASK.
+static cell rdepth(cell xt, entry_t dict[])
+{
+    if (in_kernel(xt, dict)) {
+	if (xt == C(rrto) || xt == C(rrfrom))
+	    return 2;
+	return xt == C(rdrop) || xt == C(rto) || xt == C(rfrom)
+	    || xt == C(rfetch) || xt == C(rpfetch) || xt == C(rpstore)
+	    || xt == C(locals_) || xt == C(drop_locals)
+	    || xt == C(loop_i) || xt == C(loop_j)
+	    || xt == C(leave) || xt == C(unloop);
+    }
+    if (xt >= (cell)&((entry_t*)sys.mem)->xt && xt < sys.dp)
+	return (FROM_XT(xt)->flags & RDEPTH_MASK) >> RDEPTH_SHIFT;
+    return 0;
+}
+
+static cell inline_check(cell *code, cell max, int nesting, entry_t dict[]);
+
+// Can a call to *xt* be part of inlined code? It must not change the
+// return stack, since the inlined code has no return address. The
+// code of a does> word is checked, at most INLINE_NESTING deep.
+static int inline_call(cell xt, int nesting, entry_t dict[])
+{
+    entry_t *e = FROM_XT(xt);
+
+    if (in_kernel(xt, dict))
+	return !(xt == C(semi) || xt == C(if_semi) || xt == C(zero_semi)
+		 || xt == C(tail_call) || xt == C(jump_table)
+		 || xt == C(case_search) || xt == C(of_) || xt == C(do_)
+		 || xt == C(qdo) || xt == C(loop_) || xt == C(plus_loop)
+		 || rdepth(xt, dict));
+    if (e->xt == runtime.dodoes)
+	return nesting < INLINE_NESTING
+	    && inline_check((cell*)e->doer, MEMCELLS, nesting + 1, dict) >= 0;
+    return (e->flags & INLINE && e->xt == runtime.docol)
+	|| e->xt == runtime.dovar;
+}
+
+// Number of cells in *code* before the final `;;`, if there are at
+// most *max* and the code can be inlined, otherwise -1.
+static cell inline_check(cell *code, cell max, int nesting, entry_t dict[])
+{
+    cell *end = code_end(code, dict);
+    cell *p;
+
+    if (!end || end - code > max)
+	return -1;
+    for (p = code; p < end; p++) {
+	if (seal_recorded(p))
+	    return -1;
+	if (*p == C(lit))
+	    p++;
+	else if (*p == C(branch) || *p == C(zbranch)) {
+	    p++;
+	    if (*p < (cell)code || *p > (cell)end)
+		return -1;
+	}
+	else if (!inline_call(*p, nesting, dict))
+	    return -1;
+    }
+    return end - code;
+}
+
+// The same for code that is inlined automatically
+static cell inline_length(cell *code, entry_t dict[])
+{
+    return inline_check(code, INLINE_CELLS, 0, dict);
+}
+
+/* ---------------------------------------------------------------------- */
+/* Constant folding */
+
+// Where the newest literals were compiled, newest last. Only literals
+// that `literal,` and the compiler produce are recorded, so that a
+// `lit` that was compiled with `,` is never mistaken for one.
+#define FOLD_LITERALS 4
+
+static struct {
+    cell *at[FOLD_LITERALS];
+    cell count;
+} literals;
+
+static void compile_literal(cell value, entry_t dict[])
+{
+    ALIGN(cell);
+    if (literals.count == FOLD_LITERALS) {
+	memmove(literals.at, literals.at + 1,
+		(FOLD_LITERALS - 1) * sizeof(cell*));
+	literals.count--;
+    }
+    literals.at[literals.count++] = (cell*)sys.dp;
+    COMMA(C(lit), cell);
+    COMMA(value, cell);
+}
+
+// Are the last *n* instructions before `here` recorded literals?
+static int literals_before(cell n, entry_t dict[])
+{
+    cell i;
+
+    if (n > literals.count)
+	return 0;
+    for (i = 1; i <= n; i++) {
+	cell *lit = literals.at[literals.count - i];
+
+	if (lit != (cell*)sys.dp - 2 * i || *lit != C(lit))
+	    return 0;
+    }
+    return 1;
+}
+
+// Does a branch in the newest word, or the mark of an unfinished
+// control structure on the stack at *sp*, point into (from, here]?
+static int targeted(cell *from, cell *sp)
+{
+    entry_t *e = (entry_t*)sys.root.last;
+    cell *p;
+
+    for (p = e->body; p < from; p++)
+	if (*p > (cell)from && *p <= sys.dp)
+	    return 1;
+    for (p = sp; p < (cell*)sys.s0; p++)
+	if (*p > (cell)from && *p <= sys.dp)
+	    return 1;
+    return 0;
+}
+
+// If the code before `here` is a literal and no branch goes into it,
+// remove it and return 1 with its value in *value*.
+static int literal_before(cell *value, cell *sp, entry_t dict[])
+{
+    cell *lit = (cell*)sys.dp - 2;
+
+    if (!literals_before(1, dict) || targeted(lit, sp))
+	return 0;
+    *value = lit[1];
+    literals.count--;
+    sys.dp = (cell)lit;
+    return 1;
+}
+
+#define FOLD(label, expr)  if (xt == C(label)) { *res = (cell)(expr); return 1; }
+
+// Compute the foldable kernel word *xt* for the arguments *a* and *b*
+// (b is the top of the stack). Returns 0 if it must not be computed
+// at compile time.
+static int fold_value(cell xt, cell a, cell b, cell *res, entry_t dict[])
+{
+    ucell ua = a, ub = b;
+
+    FOLD(false, FALSE); FOLD(true, TRUE);
+    FOLD(zero, 0); FOLD(one, 1); FOLD(minus_one, -1); FOLD(two, 2);
+    FOLD(per_cell, sizeof(cell));
+
+    FOLD(oneplus, b + 1); FOLD(oneminus, b - 1);
+    FOLD(twotimes, b * 2); FOLD(twodiv, b / 2);
+    FOLD(abs, cellabs(b)); FOLD(negate, -b); FOLD(not, ~b);
+    FOLD(zero_equal, BOOL(b == 0)); FOLD(zero_unequal, BOOL(b != 0));
+    FOLD(zero_less, BOOL(b < 0)); FOLD(zero_greater, BOOL(b > 0));
+
+    FOLD(minus, a - b); FOLD(plus, a + b); FOLD(times, a * b);
+    FOLD(or, a | b); FOLD(and, a & b); FOLD(xor, a ^ b);
+    FOLD(equal, BOOL(a == b)); FOLD(unequal, BOOL(a != b));
+    FOLD(less, BOOL(a < b)); FOLD(less_eq, BOOL(a <= b));
+    FOLD(greater, BOOL(a > b)); FOLD(greater_eq, BOOL(a >= b));
+    FOLD(uless, BOOL(ua < ub)); FOLD(uless_eq, BOOL(ua <= ub));
+    FOLD(ugreater, BOOL(ua > ub)); FOLD(ugreater_eq, BOOL(ua >= ub));
+
+    // A division that traps is left for the run time.
+    if (b == 0 || b == -1)
+	return 0;
+    FOLD(divide, a / b); FOLD(mod, a % b); FOLD(udivide, ua / ub);
+    return 0;
+}
+
+#undef FOLD
+
+// If *e* is a foldable kernel word whose arguments are the literals
+// just before `here`, replace them by a literal of the result.
+static int fold(entry_t *e, cell *sp, entry_t dict[])
+{
+    cell n = ((e->flags & FOLD_MASK) >> FOLD_SHIFT) - 1;
+    cell *args = (cell*)sys.dp - 2 * n, value;
+
+    if (n < 0 || !in_kernel((cell)&e->xt, dict) || !literals_before(n, dict)
+	|| (n > 0 && targeted(args, sp))
+	|| !fold_value((cell)&e->xt, n == 2 ? args[1] : 0,
+		       n > 0 ? args[2 * n - 1] : 0, &value, dict))
+	return 0;
+    literals.count -= n;
+    sys.dp = (cell)args;
+    compile_literal(value, dict);
+    return 1;
+}
+
+// Compile the mark of `if,`. A literal condition is decided now: a
+// true one compiles nothing, a false one an unconditional branch.
+static cell if_taken;           // Mark of an IF that is always taken
+
+static cell compile_if(cell *sp, entry_t dict[])
+{
+    cell flag, mark;
+
+    if (literal_before(&flag, sp, dict)) {
+	if (flag)
+	    return (cell)&if_taken;
+	COMMA(C(branch), cell);
+    } else
+	COMMA(C(zbranch), cell);
+    mark = sys.dp;
+    COMMA(0, cell);
+    return mark;
+}
+
+// Compile a copy of *code* without its final `;;`. Branches inside
+// the code are moved with it. Code without branches is folded while
+// it is copied.
+static void inline_code(cell *code, cell *sp, entry_t dict[])
+{
+    cell *end = code_end(code, dict);
+    cell *p, *to;
+    int branches = 0;
+
+    if (!end)
+	return;
+    for (p = code; p < end; p++) {
+	if (*p == C(branch) || *p == C(zbranch))
+	    branches = 1;
+	if (has_operand(*p, dict))
+	    p++;
+    }
+    ALIGN(cell);
+    to = (cell*)sys.dp;
+    for (p = code; p < end; p++) {
+	if (*p == C(tail_call)) {
+	    // The copy must return to the word it is copied into.
+	    p++;
+	    COMMA(*p, cell);
+	    continue;
+	}
+	if (!branches && *p == C(lit)) {
+	    p++;
+	    compile_literal(*p, dict);
+	    continue;
+	}
+	if (!branches && in_kernel(*p, dict) && fold(FROM_XT(*p), sp, dict))
+	    continue;
+	COMMA(*p, cell);
+	if (*p == C(branch) || *p == C(zbranch)) {
+	    p++;
+	    if (*p >= (cell)code && *p <= (cell)end)
+		COMMA((cell)to + (*p - (cell)code), cell);
+	    else
+		COMMA(*p, cell);
+	}
+	else if (*p == C(lit))
+	    p++, COMMA(*p, cell);
+    }
+}
+
+// Compile the word *e*, either as a call or as a copy of its code.
+// *sp* is the stack of the compiler.
+static void compile_word(entry_t *e, cell *sp, entry_t dict[])
+{
+    if (fold(e, sp, dict))
+	return;
+    if (e->xt == runtime.docol && e->flags & INLINE)
+	inline_code(e->body, sp, dict);
+    else if (e->xt == runtime.dovar && !in_kernel((cell)&e->xt, dict)) {
+	COMMA(C(lit), cell);
+	COMMA(e->body, cell);
+    }
+    else if (e->xt == runtime.dodoes && e->flags & FIXED
+	     && *(cell*)e->doer == C(fetch)
+	     && inline_length((cell*)e->doer, dict) >= 0) {
+	compile_literal(e->body[0], dict);
+	inline_code((cell*)e->doer + 1, sp, dict);
+    }
+    else if (e->xt == runtime.dodoes
+	     && inline_check((cell*)e->doer,
+			     e->flags & INLINE ? MEMCELLS : INLINE_CELLS,
+			     0, dict) >= 0) {
+	COMMA(C(lit), cell);
+	COMMA(e->body, cell);
+	inline_code((cell*)e->doer, sp, dict);
+    }
+    else if (e->xt == runtime.dodefer && e->flags & SEALED) {
+	ALIGN(cell);
+	sys.last_call = sys.dp;
+	seal_record((cell*)sys.dp, (cell)&e->xt);
+	COMMA(e->doer, cell);
+    }
+    else {
+	ALIGN(cell);
+	sys.last_call = sys.dp;
+	COMMA(&e->xt, cell);
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+/* Tail calls */
+
+// Set the RDEPTH bits of *e* from its code up to `here`. A word that
+// calls another one that uses n frames uses n - 1 frames itself.
+// Every cell is looked at, so data can only make the result larger.
+static void mark_rdepth(entry_t *e, entry_t dict[])
+{
+    cell *p, depth = 0;
+
+    for (p = e->body; p < (cell*)sys.dp; p++) {
+	cell d = rdepth(*p, dict);
+
+	if (!in_kernel(*p, dict) && d < 3)
+	    d--;
+	if (d > depth)
+	    depth = d;
+    }
+    e->flags = (e->flags & ~RDEPTH_MASK) | depth << RDEPTH_SHIFT;
+}
+
+// Can a call to *xt* be replaced by a jump? Only colon definitions
+// that do not look at their return address can be the target.
+static int tail_callable(cell xt, entry_t dict[])
+{
+    return !in_kernel(xt, dict) && colon_word(FROM_XT(xt))
+	&& !rdepth(xt, dict);
+}
+
+#ifdef TOKENS
+/* ---------------------------------------------------------------------- */
+/* Token threading */
+
+// With TOKENS, `;` replaces the code of a colon definition by 16-bit
+// tokens that index a table of XTs. While such code runs, `ip` holds
+// the address of the next token plus 1; `next` recognises it by the
+// odd address, and return addresses need no other mark. The operands
+// of `lit`, `branch`, `0branch` and `tail-call` are encoded by tokens
+// that are no words. The code of a word that calls a word which reads
+// its return address, like `(")`, stays threaded, and so does the code
+// of a word that uses a kernel word with another kind of operand.
+
+typedef uint16_t token_t;
+
+#define TOKENS_MAX   0x10000
+#define CELL_TOKENS  ((cell)(sizeof(cell) / sizeof(token_t)))
+
+#define TOKEN_IP(addr)     ((cell*)((char*)(addr) + 1))
+#define TOKEN_AT(ip)       ((token_t*)((char*)(ip) - 1))
+#define TOKEN_SKIP(ip, n)  ((cell*)((char*)(ip) + (n) * (cell)sizeof(token_t)))
+
+// Tokens with an operand in the following tokens
+enum {
+    TOKEN_LIT,                  // 16-bit literal
+    TOKEN_LITC,                 // Literal in the next CELL_TOKENS tokens
+    TOKEN_BRANCH,               // Offset from the operand, in tokens
+    TOKEN_ZBRANCH,
+    TOKEN_TAIL,                 // Token of the word to jump to
+    TOKEN_WORDS                 // First token of a word
+};
+
+static struct {
+    cell xt[TOKENS_MAX];        // XT of each token
+    hmap_t *of;                 // Token of each XT
+    cell count;
+} tokens;
+
+// *code* contains the routines of the tokens below TOKEN_WORDS.
+static void tokens_init(cell *code)
+{
+    cell i;
+
+    for (i = 0; i < TOKEN_WORDS; i++)
+	tokens.xt[i] = (cell)&code[i];
+    tokens.count = TOKEN_WORDS;
+    tokens.of = hmap_new(0);
+}
+
+// The token of *xt*, or -1 if the table is full. A token stays valid
+// when its word is forgotten: code that uses it is forgotten as well,
+// and a newer word with the same XT gets the same token.
+static cell token_of(cell xt)
+{
+    cell *t = hmap_get(tokens.of, xt);
+
+    if (t)
+	return *t;
+    if (tokens.count == TOKENS_MAX)
+	return -1;
+    tokens.xt[tokens.count] = xt;
+    hmap_put(tokens.of, xt, tokens.count);
+    return tokens.count++;
+}
+
+// Can token code call *xt*? It must not read the return address, and
+// a kernel word must not have an operand.
+static int token_call(cell xt, entry_t dict[])
+{
+    entry_t *e = FROM_XT(xt);
+
+    if (in_kernel(xt, dict))
+	return !has_operand(xt, dict);
+    if (xt < (cell)&((entry_t*)sys.mem)->xt || xt >= sys.dp)
+	return 0;
+    if (e->xt == runtime.dodoes)
+	return inline_call(xt, 0, dict);
+    return (colon_word(e) && !rdepth(xt, dict)) || e->xt == runtime.dovar;
+}
+
+// Replace the code of the newest word *e*, which ends with `;;` at
+// `here`, by tokens. Nothing is changed if it cannot be encoded. It
+// is not inlined, since gcc would then keep `ip` in memory in mind().
+__attribute__((noinline))
+static void tokenize(entry_t *e, entry_t dict[])
+{
+    cell *code = e->body, n = (cell*)sys.dp - code, i, k;
+    cell *at = NULL;            // Token index of each cell
+    token_t *t = NULL;
+
+    if (e->xt != runtime.docol || e->flags & INLINE || n < 1
+	|| code[n - 1] != C(semi) || seal_within((cell)code, sys.dp))
+	return;
+    at = malloc((n + 1) * sizeof(cell));
+    for (i = k = 0; i < n; i++) {
+	cell xt = code[i];
+
+	at[i] = k;
+	if (xt == C(lit) || xt == C(branch) || xt == C(zbranch)
+	    || xt == C(tail_call)) {
+	    if (i + 1 == n)
+		goto out;
+	    at[++i] = -1;
+	    if (xt == C(lit))
+		k += code[i] == (int16_t)code[i] ? 2 : 1 + CELL_TOKENS;
+	    else if (xt == C(tail_call) && token_of(code[i]) < 0)
+		goto out;
+	    else
+		k += 2;
+	} else if (token_call(xt, dict) && token_of(xt) >= 0)
+	    k++;
+	else
+	    goto out;
+    }
+    at[n] = k;
+    if (k > INT16_MAX)
+	goto out;
+
+    t = malloc(k * sizeof(token_t));
+    for (i = k = 0; i < n; i++) {
+	cell xt = code[i];
+
+	if (xt == C(lit) && code[i + 1] == (int16_t)code[i + 1]) {
+	    t[k++] = TOKEN_LIT;
+	    t[k++] = code[++i];
+	} else if (xt == C(lit)) {
+	    t[k++] = TOKEN_LITC;
+	    memcpy(&t[k], &code[++i], sizeof(cell));
+	    k += CELL_TOKENS;
+	} else if (xt == C(branch) || xt == C(zbranch)) {
+	    cell offset = code[++i] - (cell)code;
+	    cell target = offset / (cell)sizeof(cell);
+
+	    if (offset & (sizeof(cell) - 1) || target < 0 || target > n
+		|| at[target] < 0)
+		goto out;
+	    t[k] = xt == C(branch) ? TOKEN_BRANCH : TOKEN_ZBRANCH;
+	    k++;
+	    t[k] = at[target] - k;
+	    k++;
+	} else if (xt == C(tail_call)) {
+	    t[k++] = TOKEN_TAIL;
+	    t[k++] = token_of(code[++i]);
+	} else
+	    t[k++] = token_of(xt);
+    }
+    memcpy(code, t, k * sizeof(token_t));
+    sys.dp = (cell)code + k * sizeof(token_t);
+    ALIGN(cell);
+    e->xt = runtime.dotok;
+    literals.count = 0;
+    sys.last_call = 0;
+out:
+    free(at);
+    free(t);
+}
+#endif
+
+/* ---------------------------------------------------------------------- */
+/* Local variables */
+
+// Maximal number of locals in a definition, and length of their names
+#define LOCALS_MAX   16
+#define LOCAL_NAME   32
+
+// The locals of the definition that is being compiled. Each has an
+// immediate entry that compiles `local@`, with the index of the local
+// in `doer`. `find` searches them before the dictionary.
+static struct {
+    cell count;
+    cell owner;                 // (entry_t*) Definition of the locals
+    cell *start;                // Code after `(locals)`
+    char names[LOCALS_MAX][LOCAL_NAME];
+    entry_t entries[LOCALS_MAX];
+} locals;
+
+// Are the locals valid for the definition that is being compiled?
+static int locals_active(void)
+{
+    return locals.count && sys.state && locals.owner == sys.root.last;
+}
+
+// Index of the local *name*, or -1.
+static cell local_index(char *name)
+{
+    cell k;
+
+    if (locals_active())
+	for (k = locals.count - 1; k >= 0; k--)
+	    if (!strcmp(locals.names[k], name))
+		return k;
+    return -1;
+}
+
+// Add the local *name* with the runtime *dolocal*. Returns 0 if there
+// are too many locals.
+static int local_add(char *name, cell dolocal)
+{
+    entry_t *e = &locals.entries[locals.count];
+
+    if (locals.owner != sys.root.last)
+	locals.count = 0;
+    if (locals.count == LOCALS_MAX)
+	return 0;
+    locals.owner = sys.root.last;
+    snprintf(locals.names[locals.count], LOCAL_NAME, "%s", name);
+    e->name = (cell)locals.names[locals.count];
+    e->flags = IMMEDIATE;
+    e->xt = dolocal;
+    e->doer = locals.count;
+    locals.count++;
+    return 1;
+}
+
+/* ---------------------------------------------------------------------- */
+/* CASE */
+
+// A case with a constant value
+typedef struct {
+    cell value;
+    cell order;                 // Position of the case in the source
+    cell target;                // (cell*) Start of its code
+} case_entry_t;
+
+// A CASE structure while it is compiled. The cases with a constant
+// value are dispatched by a table. The other ones are compared in
+// order with `(of)` when no constant matched.
+typedef struct {
+    cell *dispatch;             // Instruction and operand of the dispatch
+    cell *clause;               // Start of the current clause
+    cell *miss;                 // Open operand of the last `(of)`, or NULL
+    cell *first_of;             // Start of the first clause with `(of)`
+    cell *endofs;               // Chain of the operands of ENDOF
+    case_entry_t *cases;
+    cell count, size;
+} case_t;
+
+static case_t *case_begin(entry_t dict[])
+{
+    case_t *c = calloc(1, sizeof(case_t));
+
+    ALIGN(cell);
+    c->dispatch = (cell*)sys.dp;
+    COMMA(C(branch), cell);
+    COMMA(0, cell);
+    c->clause = (cell*)sys.dp;
+    return c;
+}
+
+static void case_of(case_t *c, cell *sp, entry_t dict[])
+{
+    cell value;
+
+    if (literal_before(&value, sp, dict)) {
+	if (c->count == c->size) {
+	    c->size = c->size ? 2 * c->size : 16;
+	    c->cases = realloc(c->cases, c->size * sizeof(case_entry_t));
+	}
+	c->cases[c->count] = (case_entry_t) { value, c->count, sys.dp };
+	c->count++;
+	return;
+    }
+    if (c->miss)
+	*c->miss = (cell)c->clause;
+    else
+	c->first_of = c->clause;
+    COMMA(C(of_), cell);
+    c->miss = (cell*)sys.dp;
+    COMMA(0, cell);
+}
+
+static void case_endof(case_t *c, entry_t dict[])
+{
+    COMMA(C(branch), cell);
+    COMMA(c->endofs, cell);
+    c->endofs = (cell*)sys.dp - 1;
+    c->clause = (cell*)sys.dp;
+}
+
+static int case_order(const void *a, const void *b)
+{
+    const case_entry_t *x = a, *y = b;
+
+    if (x->value != y->value)
+	return x->value < y->value ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+// Compile the table of the constant cases and let the dispatch use
+// it. A miss goes to *miss*.
+static void case_table(case_t *c, cell miss, entry_t dict[])
+{
+    case_entry_t *v = c->cases;
+    cell i, n = 0, *skip, *table;
+
+    // Sort the cases; of equal values the first one counts.
+    qsort(v, c->count, sizeof(case_entry_t), case_order);
+    for (i = 0; i < c->count; i++)
+	if (n == 0 || v[i].value != v[n - 1].value)
+	    v[n++] = v[i];
+
+    COMMA(C(branch), cell);
+    skip = (cell*)sys.dp;
+    COMMA(0, cell);
+    table = (cell*)sys.dp;
+    if ((ucell)(v[n - 1].value - v[0].value) < (ucell)(2 * n + 2)) {
+	// Dense: { min, range, miss, target or 0 for each value }
+	cell range = v[n - 1].value - v[0].value + 1;
+
+	COMMA(v[0].value, cell);
+	COMMA(range, cell);
+	COMMA(miss, cell);
+	for (i = 0; i < range; i++)
+	    COMMA(0, cell);
+	for (i = 0; i < n; i++)
+	    table[3 + v[i].value - v[0].value] = v[i].target;
+	c->dispatch[0] = C(jump_table);
+    } else {
+	// Sparse: { n, miss, value and target for each case }
+	COMMA(n, cell);
+	COMMA(miss, cell);
+	for (i = 0; i < n; i++) {
+	    COMMA(v[i].value, cell);
+	    COMMA(v[i].target, cell);
+	}
+	c->dispatch[0] = C(case_search);
+    }
+    c->dispatch[1] = (cell)table;
+    *skip = sys.dp;
+}
+
+static void case_end(case_t *c, entry_t dict[])
+{
+    cell *deflt = c->clause, *p, *next;
+    cell miss = (cell)(c->first_of ? c->first_of : deflt);
+
+    COMMA(C(drop), cell);
+    if (c->miss)
+	*c->miss = (cell)deflt;
+    if (c->count)
+	case_table(c, miss, dict);
+    else
+	c->dispatch[1] = miss;
+    for (p = c->endofs; p; p = next) {
+	next = (cell*)*p;
+	*p = sys.dp;
+    }
+    free(c->cases);
+    free(c);
+}
+
+/* ---------------------------------------------------------------------- */
+/* C interface */
+
+#define MAX_C_ARGS 6
+
+// Parse the signature of a C function. It consists of one letter `n`
+// for each argument, then a `-`, then an optional `n` for the result.
+// Example: "nn-n" is a function with 2 arguments and a result.
+static int c_signature(char *sig, int *args, int *results)
+{
+    *args = strspn(sig, "n");
+    if (*args > MAX_C_ARGS || sig[*args] != '-')
+	return 0;
+    sig += *args + 1;
+    *results = strspn(sig, "n");
+    return *results <= 1 && sig[*results] == 0;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Execution trace */
+
+#ifdef TRACE
+// Print the trace. Out of line, since the structure on the stack
+// would make gcc keep the stack pointer of mind() in memory.
+__attribute__((noinline, cold))
+static void trace_print(entry_t dict[])
+{
+    trace_env_t env = { dict, num_words, (cell)sys.mem, sys.dp };
+
+    trace_dump(stderr, &env);
+}
+
+// Code addresses of the kernel words while they are traced
+static cell trace_code[num_words];
+static int trace_switched;
+
+// Route the kernel words through *trace* while words are recorded,
+// and back when not. The words of the runtimes check `trace_flags`
+// themselves, so `next` needs no test.
+static void trace_switch(label_t trace, entry_t dict[])
+{
+    int on = (trace_flags & TRACE_ON) != 0;
+    cell i;
+
+    if (on == trace_switched)
+	return;
+    trace_switched = on;
+    for (i = 0; i < num_words; i++) {
+	if (dict[i].xt == runtime.dodefer)
+	    continue;
+	if (on) {
+	    trace_code[i] = dict[i].xt;
+	    dict[i].xt = (cell)trace;
+	}
+	else
+	    dict[i].xt = trace_code[i];
+    }
+}
+
+// Record the word *xt*, called from *ip*, and return *xt*. The trace
+// is dumped when `abort` is called while tracing is on.
+static cell trace_step(cell xt, cell *ip, cell *sp, entry_t dict[])
+{
+    if (trace_flags & TRACE_ON)
+	trace_record(xt, (cell)(ip - 1), (cell*)sys.s0 - sp);
+    if (trace_flags & TRACE_DUMP || (trace_flags & TRACE_ON && xt == C(abort))) {
+	trace_flags &= ~TRACE_DUMP;
+	trace_print(dict);
+    }
+    return xt;
+}
+
+// The word pointer is returned, so that it does not need a register
+// that survives the call.
+#define TRACE_STEP							\
+    if (trace_flags)							\
+	w = (label_t*)trace_step((cell)w, ip, sp, dict)
+#else
+#define TRACE_STEP
+#endif
+
 /* ---------------------------------------------------------------------- */
 
 void mind()
@@ -211,6 +1333,7 @@ void mind()
     label_t *w;			/* Word Pointer */
     cell *rp;			/* Return Stack Pointer */
     cell *sp;			/* Stack Pointer */
+    cell *lp = NULL;		/* Locals of the current word */
     ref_t obj;                  // Active object
 
     static entry_t dict[] = { /* Dictionary */
@@ -220,23 +1343,59 @@ void mind()
 #undef D
 #undef E
     };
+    // Return address in a frame of locals
+    static cell unlocals_code[] = { C(unlocals) };
 
 // ---------------------------------------------------------------------------
 // Starting and ending
+    runtime.docol = (cell)&&docol;
+    runtime.dovar = (cell)&&dovar;
+    runtime.dodoes = (cell)&&dodoes;
+    runtime.dodefer = (cell)&&dodefer;
+#ifdef TOKENS
+    {
+	static cell token_code[] = {
+	    (cell)&&token_lit, (cell)&&token_litc, (cell)&&token_branch,
+	    (cell)&&token_zbranch, (cell)&&token_tail };
+
+	runtime.dotok = (cell)&&dotok;
+	tokens_init(token_code);
+    }
+#endif
     init_sys(dict);
 
+    static stats_env_t stats_env;
+    stats_env = (stats_env_t) {
+	.dp = &sys.dp, .mem = sys.mem, .mem_end = sys.mem + MEMCELLS,
+	.stack_limit = (cell*)sys.s0 - STATS_STACK, .s0 = (cell*)sys.s0,
+	.rstack = sys.rstack, .r0 = (cell*)sys.r0,
+	.ostack = (cell*)sys.ostack, .op0 = (cell*)sys.op0 };
+    stats_init(&stats_env);
+    if (args.metrics)
+	stats_start((char*)args.metrics, &stats_env);
+
+#ifndef MIND_AOT
     file_open(&sys.inf,
               mind_relative((char*)args.raw_argv[0], "init.mind"));
     if (sys.inf.current == EOF) {
 	fprintf(stderr, "Error: File '%s' not found\n", (char*)sys.inf.name);
 	exit(-1);
     }
+#endif
 
     sp = (cell*)sys.s0;
     rp = (cell*)sys.r0;
     obj.this = 0;
     obj.class = (cell)&sys.inf.stream;
 
+#ifdef TRACE
+    trace_init();
+#endif
+
+#ifdef MIND_AOT
+    goto aot_start;
+#endif
+
     {
 	static cell interpreter[] = { C(do_stream), C(boot) };
 	ip = interpreter;
@@ -244,8 +1403,15 @@ void mind()
     }
 
 bye:
+    if (args.metrics)
+	stats_write((char*)args.metrics, &stats_env);
     return;
 
+#ifdef MIND_AOT
+// The program generated by `compile-to-c`
+#include MIND_AOT
+#endif
+
 // ---------------------------------------------------------------------------
 // Objects
 
@@ -272,18 +1438,45 @@ end_scope:  // }
 // Inner interpreter
 
 next:				/* Address Interpreter */
-    w = (label_t*)*ip++; goto **w;
+#ifdef TOKENS
+    if ((cell)ip & 1) {
+	w = (label_t*)tokens.xt[*TOKEN_AT(ip)];
+	ip = TOKEN_SKIP(ip, 1);
+	goto **w;
+    }
+#endif
+    w = (label_t*)*ip++;
+    goto **w;
+
+#ifdef TRACE
+trace:				/* Kernel words while they are traced */
+    w = (label_t*)trace_step((cell)w, ip, sp, dict);
+    goto *(label_t)trace_code[FROM_XT(w) - dict];
+#endif
 
 docol:				/* Runtime of ":" */
+    TRACE_STEP;
+    stats.calls++;
     RPUSH(ip); ip = FROM_XT(w)->body; goto next;
 
+#ifdef TOKENS
+dotok:				/* Runtime of ":" in tokens */
+    TRACE_STEP;
+    stats.calls++;
+    RPUSH(ip); ip = TOKEN_IP(FROM_XT(w)->body); goto next;
+#endif
+
 dodefer:			/* Runtime of Defer */
+    TRACE_STEP;
     w = (label_t*)FROM_XT(w)->doer; goto **w;
 
 dovar:				/* Runtime of Variable */
+    TRACE_STEP;
     PUSH(FROM_XT(w)->body); goto next;
 
 dodoes: //			Runtime for Create ... does>
+    TRACE_STEP;
+    stats.calls++;
     PUSH(FROM_XT(w)->body);
     RPUSH(ip); ip = (cell*)FROM_XT(w)->doer; goto next;
 
@@ -330,7 +1523,7 @@ exec_compile: // exec/compile ( xt -- )
             entry_t *e = FROM_XT(xt);
 
 	    if (sys.state && !(e->flags & IMMEDIATE)) {
-		COMMA(&e->xt, cell);
+		compile_word(e, sp, dict);
 		goto next;
 	    }
 	    else
@@ -353,22 +1546,31 @@ notfound: // Tell that the word at sys.dp could not be interpreted
     }
 
 find: // find ( str -- xt | 0 )
-    FUNC1(find_xt((entry_t*)(sys.root.last), (char*)TOS));
+    {
+	cell k = local_index((char*)TOS);
+
+	if (k >= 0) {
+	    FUNC1(&locals.entries[k].xt);
+	}
+	FUNC1(count_find(find_xt((entry_t*)(sys.root.last), (char*)TOS),
+			 (char*)TOS));
+    }
 find_word: // find-word ( str ctx -- xt | 0 )
-    FUNC2(find_xt((entry_t*)((context_t*)TOS)->last, (char*)NOS));
+    FUNC2(count_find(find_xt((entry_t*)((context_t*)TOS)->last, (char*)NOS),
+		     (char*)NOS));
 
 parse_to: // : parse-to ( addr str -- )
           //   { file: >r
           //   BEGIN i append  get
           //      r@ i strchr  i? 0= or UNTIL rdrop
-          //   0 over c!  i? 0= if; get } ;
+          //   0 over c!  i? IF get THEN } ;
     CODE(C(scope), C(file_colon), C(rto),
 	 C(i), C(append), C(get),
 	 C(rfetch), C(i), C(strchr),
          C(iq), C(zero_equal), C(or),
 	 C(zbranch), (cell)(start + 3), C(rdrop),
 	 C(zero), C(swap), C(cstore),
-         C(iq), C(zero_equal), C(if_semi), C(get), C(end_scope));
+         C(iq), C(zbranch), (cell)(start + 22), C(get), C(end_scope));
 
 skip_whitespace: // : skip-whitespace ( -- )
 	         //   BEGIN  whitespace i strchr 0= if;  get AGAIN ;
@@ -380,17 +1582,19 @@ parse: // : parse ( -- addr )
     CODE(C(scope), C(file_colon), C(skip_whitespace),
          C(here), C(whitespace), C(parse_to), C(here), C(end_scope));
 
-backslash: // : \   { file: BEGIN i get  #eol = if;
+backslash: // : \   { file: BEGIN i get  #eol = IF } ;; THEN
            //                      i? 0= UNTIL } ;  immediate
     CODE(C(scope), C(file_colon),
-         C(i), C(get), C(num_eol), C(equal), C(if_semi),
+         C(i), C(get), C(num_eol), C(equal),
+	 C(zero_equal), C(zbranch), (cell)(start + 13),
 	 C(iq), C(zero_equal), C(zbranch), (cell)(start + 2),
          C(end_scope));
 
-paren: // : (   { file: BEGIN i get  [char] ) = if;
+paren: // : (   { file: BEGIN i get  [char] ) = IF } ;; THEN
        //                      i? 0= UNTIL } ;  immediate
     CODE(C(scope), C(file_colon),
-         C(i), C(get), C(lit), ')', C(equal), C(if_semi),
+         C(i), C(get), C(lit), ')', C(equal),
+	 C(zero_equal), C(zbranch), (cell)(start + 14),
 	 C(iq), C(zero_equal), C(zbranch), (cell)(start + 2),
          C(end_scope));
 
@@ -404,6 +1608,7 @@ argv:     FUNC0(args.argv);
 
 arg_cmdline:     FUNC0(&args.command);
 arg_interactive: FUNC0(&args.interactive);
+arg_server:      FUNC0(&args.server);
 
 // ---------------------------------------------------------------------------
 // Files
@@ -464,6 +1669,26 @@ lines_i:             // lines-i ( -- char )
 lines_iq:            // lines-i?   ( -- flag )
     FUNC0(BOOL(((lines_t*)obj.class)->line != 0));
 
+per_records: FUNC0(sizeof(records_t)); // /records
+records_open:        // records-open   ( str size records -- )
+    PROCN(3, records_open((records_t*)TOS, (char*)sp[2], NOS));
+records_close:       // records-close  ( records -- )
+    PROC1(records_close((records_t*)TOS));
+records_slice:       // (records-slice) ( k n from to -- flag )
+    FUNCN(4, BOOL(records_slice((records_t*)NOS, (records_t*)TOS,
+				sp[3], sp[2])));
+records_get:         // records-get ( -- )
+    { records_t *rec = (records_t*)obj.class; rec->current += rec->size; }
+    goto next;
+records_i:           // records-i ( -- addr )
+    FUNC0(((records_t*)obj.class)->current);
+records_iq:          // records-i? ( -- flag )
+    { records_t *rec = (records_t*)obj.class;
+      FUNC0(BOOL(rec->current < rec->end)); }
+records_count:       // records-count ( -- n )
+    { records_t *rec = (records_t*)obj.class;
+      FUNC0((rec->end - rec->current) / rec->size); }
+
 do_stream: // : do-stream   BEGIN interpret { file: i? } 0= UNTIL ;
     CODE(C(interpret),
          C(scope), C(file_colon), C(iq), C(end_scope),
@@ -471,6 +1696,259 @@ do_stream: // : do-stream   BEGIN interpret { file: i? } 0= UNTIL ;
 
 errno_: FUNC0(&errno); // ( -- addr )
 
+// ---------------------------------------------------------------------------
+// Execution trace
+
+#ifdef TRACE
+trace_on:  // trace-on
+    trace_flags |= TRACE_ON; trace_switch(&&trace, dict); goto next;
+trace_off: // trace-off
+    trace_flags &= ~TRACE_ON; trace_switch(&&trace, dict); goto next;
+trace_onq: FUNC0(BOOL(trace_flags & TRACE_ON)); // trace-on? ( -- flag )
+trace_dump: trace_print(dict); goto next;       // trace-dump
+#else
+trace_on:
+trace_off:
+trace_dump:
+    goto next;
+trace_onq: FUNC0(FALSE);
+#endif
+
+// ---------------------------------------------------------------------------
+// Metrics
+
+dot_stats:   // .stats
+    stats_print(stdout, &stats_env); goto next;
+dot_memory:  // .memory
+    stats_print_memory(stdout, &stats_env); goto next;
+file_bytes:  // file-bytes ( str -- n )
+    FUNC1(stats_file_bytes((char*)TOS, sys.dp));
+file_start:  // (file-start) ( str -- )
+    cache_read((char*)TOS);
+    PROC1(stats_file_start((char*)TOS, sys.dp));
+file_end:    // (file-end)
+    stats_file_end(sys.dp); goto next;
+dot_code_size: // .code-size
+    {
+	code_size_t n;
+	cell bytes, table;
+
+	code_size(&n, dict);
+	bytes = n.cells * sizeof(cell);
+	table = n.table * sizeof(cell);
+	printf("colon definitions %10"PRIdCELL"\n", n.words);
+	printf("references        %10"PRIdCELL"\n", n.refs);
+	printf("threaded code     %10"PRIdCELL" bytes\n", bytes);
+	printf("16-bit tokens     %10"PRIdCELL" bytes  %3"PRIdCELL"%%\n",
+	       n.bytes16, bytes ? 100 * n.bytes16 / bytes : 0);
+	printf("32-bit tokens     %10"PRIdCELL" bytes  %3"PRIdCELL"%%\n",
+	       n.bytes32, bytes ? 100 * n.bytes32 / bytes : 0);
+	printf("table of XTs      %10"PRIdCELL" bytes\n", table);
+#ifdef TOKENS
+	printf("words in tokens   %10"PRIdCELL"\n", n.token_words);
+	printf("their tokens      %10"PRIdCELL" bytes\n", n.token_bytes);
+#endif
+	goto next;
+    }
+abort_start: // (abort-start)
+    stats_file_abort(sys.dp);
+    cache_abort();
+    stats.aborts++;
+    stats.abort_start = stats_time();
+    goto next;
+abort_end:   // (abort-end)
+    if (stats.abort_start) {
+	stats.abort_ns += stats_time() - stats.abort_start;
+	stats.abort_start = 0;
+    }
+    goto next;
+
+// ---------------------------------------------------------------------------
+// Cache for compiled files
+
+#define CACHE_ENV						\
+    static cache_env_t env = {					\
+	.mem = sys.mem, .mem_end = sys.mem + MEMCELLS,		\
+	.dp = &sys.dp, .last = &sys.root.last, .state = &sys.state,	\
+	.dict = dict, .num_words = num_words }
+
+cache_key:  // (cache-key) ( str -- key )
+    { CACHE_ENV; FUNC1(cache_key(&env, (char*)TOS)); }
+cache_load: // (cache-load) ( str key -- flag )
+    {
+	CACHE_ENV;
+	cell dp = sys.dp;
+
+	if (!cache_load(&env, (char*)NOS, TOS)) {
+	    FUNC2(FALSE);
+	}
+	// The file owns the whole loaded segment.
+	stats_file_start((char*)NOS, dp);
+	stats_file_end(sys.dp);
+	FUNC2(TRUE);
+    }
+cache_mark: // (cache-mark) ( key -- mark )
+    { CACHE_ENV; FUNC1(cache_mark(&env, TOS)); }
+cache_save: // (cache-save) ( str mark -- )
+    {
+	CACHE_ENV;
+	cache_mark_t *mark = (cache_mark_t*)TOS;
+
+	// `is` could not restore the sealed calls after a load.
+	if (seal_within(mark->start, sys.dp))
+	    mark->key = 0;
+#ifdef TOKENS
+	// Tokens index a table that only this process has.
+	mark->key = 0;
+#endif
+	PROC2(cache_save(&env, (char*)NOS, mark));
+    }
+
+// ---------------------------------------------------------------------------
+// Persistent regions
+
+region_open:   // (region-open) ( str size -- region | 0 )
+    FUNC2(region_open((char*)NOS, TOS));
+region_close:  // region-close ( region -- )
+    PROC1(region_close((region_t*)TOS));
+region_allot:  // region-allot ( n region -- offset )
+    FUNC2(region_allot((region_t*)TOS, NOS));
+region_main:   // region-main ( size region -- offset )
+    FUNC2(region_main((region_t*)TOS, NOS));
+region_commit: // (region-commit) ( region -- )
+    PROC1(region_commit((region_t*)TOS));
+region_size:   // region-size ( region -- n )
+    FUNC1(((region_t*)TOS)->length);
+region_base:   // region-base ( region -- addr )
+    { region_t *r = (region_t*)TOS; region_update(r); TOS = (cell)r->base; }
+    goto next;
+
+// ---------------------------------------------------------------------------
+// Hashing
+
+hash_bytes_: // hash-bytes ( addr len -- h )
+    FUNC2(hash_bytes((void*)NOS, TOS));
+hash_cell_:  // hash-cell ( x -- h )
+    FUNC1(hash_cell(TOS));
+crc32c_:     // crc32c ( addr len seed -- crc )
+    FUNCN(3, crc32c((void*)sp[2], NOS, TOS));
+
+// ---------------------------------------------------------------------------
+// Hash maps
+
+hmap_new:     FUNC0(hmap_new(FALSE)); // hmap-new ( -- hmap )
+str_hmap_new: FUNC0(hmap_new(TRUE));  // str-hmap-new ( -- hmap )
+hmap_free:    // hmap-free ( hmap -- )
+    PROC1(hmap_free((hmap_t*)TOS));
+hmap_put:     // hmap-put ( value key hmap -- )
+    PROCN(3, hmap_put((hmap_t*)TOS, NOS, sp[2]));
+hmap_get:     // hmap-get ( key hmap -- addr | 0 )
+    FUNC2(hmap_get((hmap_t*)TOS, NOS));
+hmap_del:     // hmap-del ( key hmap -- )
+    PROC2(hmap_del((hmap_t*)TOS, NOS));
+hmap_count:   // hmap-count ( hmap -- n )
+    FUNC1(((hmap_t*)TOS)->count);
+hmap_next:    // hmap-next ( i hmap -- i' )
+    FUNC2(hmap_next((hmap_t*)TOS, NOS));
+hmap_entry:   // hmap-entry ( i hmap -- value key )
+    {
+	hslot_t *s = hmap_slot((hmap_t*)TOS, NOS);
+
+	NOS = s->value;
+	TOS = s->key;
+	goto next;
+    }
+
+// ---------------------------------------------------------------------------
+// Sorting
+
+sort_cells:   // sort-cells ( addr n -- )
+    PROC2(radix_sort((cell*)NOS, TOS, TRUE));
+usort_cells:  // usort-cells ( addr n -- )
+    PROC2(radix_sort((cell*)NOS, TOS, FALSE));
+sort_records: // sort-records ( addr n size offset -- )
+    PROCN(4, sort_records((char*)sp[3], sp[2], NOS, TOS));
+
+sort_by:      // sort-by ( addr n xt -- )
+    {
+	sortby_t *s = sortby_new((cell*)sp[2], NOS);
+
+	s->thread[0] = TOS;
+	s->thread[1] = C(sort_step);
+	DROP(3);
+	RPUSH(ip);
+	RPUSH(s);
+	goto sort_resume;
+    }
+sort_step:    // (sort-step) ( flag -- )   after a comparison
+    ((sortby_t*)*rp)->less = TOS;
+    DROP(1);
+sort_resume:
+    {
+	sortby_t *s = (sortby_t*)*rp;
+
+	if (sortby_step(s)) {
+	    EXTEND(2);
+	    NOS = s->a;
+	    TOS = s->b;
+	    ip = s->thread;
+	    goto next;
+	}
+	free(s);
+	RDROP;
+	ip = (cell*)RPOP;
+	goto next;
+    }
+
+// ---------------------------------------------------------------------------
+// Processes and channels
+
+fork_:        // fork ( -- pid )
+    fflush(stdout); fflush(stderr); FUNC0(fork());
+exit_process: // exit-process ( n -- )
+    fflush(stdout); fflush(stderr); _exit(TOS);
+wait_pid:     // wait-pid ( pid -- status )
+    { int status = 0;
+      if (waitpid(TOS, &status, 0) < 0) status = -1;
+      FUNC1(status); }
+
+chan_new:     // chan-new ( n -- chan | 0 )
+    FUNC1(chan_new(TOS));
+chan_free:    // chan-free ( chan -- )
+    PROC1(chan_free((chan_t*)TOS));
+chan_close:   // chan-close ( chan -- )
+    PROC1(chan_close((chan_t*)TOS));
+chan_spin:    // chan-spin ( n chan -- )
+    PROC2(((chan_t*)TOS)->spin = NOS);
+chan_send:    // chan-send ( x chan -- )
+    PROC2(chan_send_n((chan_t*)TOS, &NOS, 1));
+chan_recv:    // chan-recv ( chan -- x )
+    { cell x = 0; chan_recv_n((chan_t*)TOS, &x, 1); FUNC1(x); }
+chan_send_n:  // chan-send-n ( addr n chan -- )
+    PROCN(3, chan_send_n((chan_t*)TOS, (cell*)sp[2], NOS));
+chan_recv_n:  // chan-recv-n ( addr n chan -- n' )
+    FUNCN(3, chan_recv_n((chan_t*)TOS, (cell*)sp[2], NOS));
+
+server_open:  // server-open ( str -- fd )
+    FUNC1(server_open((char*)TOS));
+server_fork:  // server-fork ( fd n -- flag )  true in a child with a request
+    if (server_fork(NOS, TOS) < 0) {
+	FUNC2(FALSE);
+    } else {
+	args.metrics = 0;
+	FUNC2(TRUE);
+    }
+
+per_chanstream: FUNC0(sizeof(chanstream_t)); // /chanstream
+chanstream_open:     // chanstream-open ( chan chanstream -- )
+    PROC2(chanstream_open((chanstream_t*)TOS, (chan_t*)NOS));
+chanstream_get:      // chanstream-get ( -- )
+    chanstream_get((chanstream_t*)obj.class); goto next;
+chanstream_i:        // chanstream-i ( -- x )
+    FUNC0(((chanstream_t*)obj.class)->current);
+chanstream_iq:       // chanstream-i? ( -- flag )
+    FUNC0(((chanstream_t*)obj.class)->valid);
+
 
 // ---------------------------------------------------------------------------
 // Dictionary
@@ -492,6 +1970,7 @@ entry_comma:                      // entry, ( str xt -- )
         *(entry_t*)sys.dp = (entry_t) {
             .link = sys.root.last,
             .name = NOS,
+            .flags = name_key((char*)NOS),
             .xt = TOS,
         };
 
@@ -510,13 +1989,12 @@ create_comma: // : Create, ( 'interpreter <word> -- )
 colon_comma: // : :, ( <word> -- )   ^docol Create, ;
     CODE(C(docol_addr), C(create_comma));
 
-#define FROM_BODY(addr)                                 \
-    ((entry_t*)((char*)(addr) - offsetof(entry_t, body)))
-
 link_to:     FUNC1(&((entry_t*)TOS)->xt);	// link>  ( lfa -- xt )
 body_to:     FUNC1(&FROM_BODY(TOS)->xt);        // body>  ( body -- xt )
-flags_fetch: FUNC1(FROM_XT(TOS)->flags);	// flags@ ( xt -- n )
-flags_store: PROC2(FROM_XT(TOS)->flags = NOS);  // flags! ( n xt -- )
+flags_fetch: FUNC1(FROM_XT(TOS)->flags & FLAG_MASK); // flags@ ( xt -- n )
+flags_store:                                         // flags! ( n xt -- )
+    PROC2(FROM_XT(TOS)->flags =
+	  (FROM_XT(TOS)->flags & ~FLAG_MASK) | (NOS & FLAG_MASK));
 
 to_link: FUNC1(&FROM_XT(TOS)->link);	// >link ( xt -- 'link )
 to_name: FUNC1(&FROM_XT(TOS)->name);	// >name ( xt -- 'name )
@@ -524,6 +2002,125 @@ to_doer: FUNC1(&FROM_XT(TOS)->doer);	// >doer ( xt -- 'doer )
 to_body: FUNC1(&FROM_XT(TOS)->body);	// >body ( xt -- 'body )
 
 num_immediate: FUNC0(IMMEDIATE); // #immediate
+num_fixed:     FUNC0(FIXED);     // #fixed
+num_inline:    FUNC0(INLINE);    // #inline
+
+qtail: // ?tail ( -- )  Replace a call at the end of the newest word by a jump
+    {
+	entry_t *e = (entry_t*)sys.root.last;
+	cell *p, xt;
+
+	if (e->xt != (cell)&&docol)
+	    goto next;
+	mark_rdepth(e, dict);
+	if (sys.last_call != sys.dp - (cell)sizeof(cell))
+	    goto next;
+	xt = *(cell*)sys.last_call;
+	if (!tail_callable(xt, dict))
+	    goto next;
+	// A branch to `here` would now go to the operand.
+	for (p = e->body; p < (cell*)sys.dp; p++)
+	    if (*p == sys.dp)
+		goto next;
+	*(cell*)sys.last_call = C(tail_call);
+	COMMA(xt, cell);
+	goto next;
+    }
+
+tail_comma: // tail, ( xt -- )  Compile a call to xt and an exit
+    if (tail_callable(TOS, dict)) {
+	if (locals_active())
+	    COMMA(C(drop_locals), cell);
+	COMMA(C(tail_call), cell);
+	COMMA(TOS, cell);
+    } else
+	COMMA(TOS, cell);
+    COMMA(C(semi), cell);
+    DROP(1);
+    goto next;
+
+seal: // seal ( xt -- )  Let the calls of the Defer word xt go to its target
+    {
+	entry_t *e = FROM_XT(TOS), *p, *newer = NULL;
+	cell *c, *end;
+
+	DROP(1);
+	if (e->xt != (cell)&&dodefer || e->flags & SEALED)
+	    goto next;
+	e->flags |= SEALED;
+	for (p = (entry_t*)sys.root.last; p && !in_kernel((cell)p, dict);
+	     newer = p, p = (entry_t*)p->link) {
+	    if (p->xt != (cell)&&docol)
+		continue;
+	    end = newer ? (cell*)newer : (cell*)sys.dp;
+	    for (c = p->body; c < end; c++) {
+		if (*c == (cell)&e->xt) {
+		    *c = e->doer;
+		    seal_record(c, (cell)&e->xt);
+		}
+		else if (has_operand(*c, dict))
+		    c++;
+	    }
+	}
+	goto next;
+    }
+unseal_: // unseal ( xt -- )  Restore the calls of the Defer word xt
+    PROC1(unseal(FROM_XT(TOS), dict));
+sealedq: // sealed? ( xt -- flag )
+    FUNC1(BOOL(FROM_XT(TOS)->flags & SEALED));
+
+literal_comma: PROC1(compile_literal(TOS, dict));     // literal, ( n -- )
+if_comma:                                            // if, ( -- addr )
+    {
+	cell mark = compile_if(sp, dict);
+
+	FUNC0(mark);
+    }
+case_comma:    FUNC0(case_begin(dict));                   // case, ( -- c )
+of_comma:      case_of((case_t*)TOS, sp, dict); goto next; // of, ( c -- c )
+endof_comma:   case_endof((case_t*)TOS, dict); goto next; // endof, ( c -- c )
+endcase_comma: PROC1(case_end((case_t*)TOS, dict));       // endcase, ( c -- )
+
+marker_: // (marker) ( -- marker )  Remember the state of the dictionary
+    FUNC0(marker_new(dict));
+forget_marker: // (forget-marker) ( marker -- )
+    {
+	marker_t *m = (marker_t*)TOS;
+
+	DROP(1);
+	forget(m->dp, m->last, dict);
+	literals.count = 0;
+	goto next;
+    }
+forget_: // (forget) ( xt -- flag )  Remove xt and all newer words
+    {
+	entry_t *e = FROM_XT(TOS);
+	cell dp = (cell)e;
+
+	if (in_kernel(TOS, dict) || dp < (cell)sys.mem || dp >= sys.dp) {
+	    FUNC1(FALSE);
+	}
+	if (e->name >= (cell)sys.mem && e->name < dp)
+	    dp = e->name;
+	forget(dp, e->link, dict);
+	literals.count = 0;
+	FUNC1(TRUE);
+    }
+
+qinline: // ?inline ( -- )  Mark the newest word as inline if it is short
+    {
+	entry_t *e = (entry_t*)sys.root.last;
+
+	if (e->xt == (cell)&&docol && inline_length(e->body, dict) >= 0)
+	    e->flags |= INLINE;
+	goto next;
+    }
+
+qtokens: // ?tokens ( -- )  Compile the newest word to tokens, with TOKENS
+#ifdef TOKENS
+    tokenize((entry_t*)sys.root.last, dict);
+#endif
+    goto next;
 
 // ---------------------------------------------------------------------------
 // Inline constants
@@ -541,6 +2138,136 @@ zbranch:			/* flag -- */
 
 lit: FUNC0(*ip++);              // ( -- n )
 
+#ifdef TOKENS
+// The tokens below TOKEN_WORDS
+token_lit:
+    PUSH((int16_t)*TOKEN_AT(ip)); ip = TOKEN_SKIP(ip, 1); goto next;
+token_litc:
+    EXTEND(1);
+    memcpy(sp, TOKEN_AT(ip), sizeof(cell));
+    ip = TOKEN_SKIP(ip, CELL_TOKENS);
+    goto next;
+token_branch:
+    ip = TOKEN_SKIP(ip, (int16_t)*TOKEN_AT(ip)); goto next;
+token_zbranch:
+    if (TOS)
+	ip = TOKEN_SKIP(ip, 1);
+    else
+	ip = TOKEN_SKIP(ip, (int16_t)*TOKEN_AT(ip));
+    DROP(1);
+    goto next;
+token_tail:
+    w = (label_t*)tokens.xt[*TOKEN_AT(ip)];
+    ip = (cell*)RPOP;
+    goto **w;
+#endif
+
+jump_table: // jump-table ( n -- | n )  Dispatch by the table in the next cell
+    {
+	cell *t = (cell*)*ip;
+	ucell i = TOS - t[0];
+
+	if (i < (ucell)t[1] && t[3 + i]) {
+	    DROP(1);
+	    ip = (cell*)t[3 + i];
+	} else
+	    ip = (cell*)t[2];
+	goto next;
+    }
+
+case_search: // case-search ( n -- | n )  Binary search in the table in the next cell
+    {
+	cell *t = (cell*)*ip, lo = 0, hi = t[0];
+
+	while (lo < hi) {
+	    cell mid = (lo + hi) / 2;
+
+	    if (t[2 + 2 * mid] < TOS)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	if (lo < t[0] && t[2 + 2 * lo] == TOS) {
+	    DROP(1);
+	    ip = (cell*)t[3 + 2 * lo];
+	} else
+	    ip = (cell*)t[1];
+	goto next;
+    }
+
+of_: // (of) ( x1 x2 -- | x1 )  If x1 = x2 continue, else jump to the next cell
+    if (TOS == NOS) {
+	DROP(2);
+	ip++;
+    } else {
+	DROP(1);
+	ip = (cell*)*ip;
+    }
+    goto next;
+
+tail_call: // tail-call ( -- )  Jump to the colon definition that follows
+#ifdef TOKENS
+    // The target may be in tokens; its runtime pushes the return
+    // address again.
+    w = (label_t*)*ip; ip = (cell*)RPOP; goto **w;
+#else
+    w = (label_t*)*ip; ip = FROM_XT(w)->body; goto next;
+#endif
+
+// ---------------------------------------------------------------------------
+// Counted loops
+
+// A loop keeps three cells on the return stack: from the top, the
+// index, the limit, and the address after the loop for `LEAVE`. The
+// operand of `(do)` is this address, the operand of `(loop)` the
+// start of the loop.
+
+do_:  // (do) ( limit start -- )
+    RPUSH(*ip++);
+    RPUSH(NOS);
+    RPUSH(TOS);
+    DROP(2);
+    goto next;
+qdo:  // (?do) ( limit start -- )  Skip the loop if limit = start
+    if (TOS == NOS) {
+	DROP(2);
+	ip = (cell*)*ip;
+	goto next;
+    }
+    goto do_;
+loop_: // (loop) ( -- )
+    if (++rp[0] != rp[1]) {
+	ip = (cell*)*ip;
+	goto next;
+    }
+    rp += 3;
+    ip++;
+    goto next;
+plus_loop: // (+loop) ( n -- )  End when the index crosses limit-1 and limit
+    {
+	ucell d = rp[0] - rp[1], d2 = d + TOS;
+
+	rp[0] += TOS;
+	if ((cell)(d ^ d2) >= 0 || (cell)(d ^ TOS) >= 0) {
+	    ip = (cell*)*ip;
+	    DROP(1);
+	    goto next;
+	}
+	rp += 3;
+	ip++;
+	DROP(1);
+	goto next;
+    }
+loop_i: FUNC0(rp[0]);           // I ( -- n )
+loop_j: FUNC0(rp[3]);           // J ( -- n )
+leave:  // LEAVE ( -- )  Continue after the loop
+    ip = (cell*)rp[2];
+    rp += 3;
+    goto next;
+unloop: // UNLOOP ( -- )  Remove the loop before ;;
+    rp += 3;
+    goto next;
+
 // ---------------------------------------------------------------------------
 // Return stack
 
@@ -557,7 +2284,88 @@ rrfrom: // rr> ( -- n )
 rfetch:  FUNC0(*rp);             // r@  ( -- n)
 r0:      FUNC0(&sys.r0);         // r0  ( -- addr)
 rpfetch: FUNC0(rp);              // rp@ ( -- addr )
-rpstore: PROC1(rp = (cell*)TOS); // rp! ( addr -- )
+rpstore: // rp! ( addr -- )  Also drop the locals above addr
+    rp = (cell*)TOS;
+    while (lp && lp < rp)
+	lp = (cell*)lp[-2];
+    DROP(1);
+    goto next;
+
+// ---------------------------------------------------------------------------
+// Local variables
+
+// A frame on the return stack contains, from the top: the address of
+// `unlocals_code`, which `;;` takes as return address, the previous
+// `lp`, the number of locals, and the locals. `lp` points to the
+// first local.
+
+locals_: // (locals) ( x1 .. xn -- )  Move the n cells in the next cell to a frame
+    {
+	cell n = *ip++, k;
+
+	rp -= n;
+	for (k = 0; k < n; k++)
+	    rp[k] = sp[n - 1 - k];
+	DROP(n);
+	RPUSH(n);
+	RPUSH(lp);
+	lp = rp + 2;
+	RPUSH(unlocals_code);
+	goto next;
+    }
+local_fetch: FUNC0(lp[*ip++]);          // local@ ( -- x )
+local_store: PROC1(lp[*ip++] = TOS);    // local! ( x -- )
+exit_locals: // (exit-locals)  ;; of a word with locals
+    if (*rp != (cell)unlocals_code) {
+	// Another word, like `push`, has put code to run at the exit
+	// above the frame.
+	ip = (cell*)RPOP;
+	goto next;
+    }
+    RDROP;
+unlocals:    // (unlocals)  Drop the frame and return
+    lp = (cell*)rp[0];
+    rp += 2 + rp[1];
+    ip = (cell*)RPOP;
+    goto next;
+drop_locals: // (drop-locals)  Drop the frame before a tail call
+    if (*rp == (cell)unlocals_code) {
+	RDROP;
+	lp = (cell*)rp[0];
+	rp += 2 + rp[1];
+    }
+    goto next;
+
+dolocal:     // Runtime of the entries of locals: compile `local@`
+    COMMA(C(local_fetch), cell);
+    COMMA(FROM_XT(w)->doer, cell);
+    goto next;
+
+local_name: // (local-name) ( str -- flag )  Declare a local
+    FUNC1(BOOL(local_add((char*)TOS, (cell)&&dolocal)));
+local_:     // (local) ( str -- n | -1 )  Index of the local str
+    FUNC1(local_index((char*)TOS));
+num_locals: // #locals ( -- n )  Number of locals of the current definition
+    FUNC0(locals_active() ? locals.count : 0);
+locals_start: // (locals-start) ( -- )  The frame starts here
+    locals.start = (cell*)sys.dp;
+    goto next;
+end_locals: // (end-locals) ( -- )  Compile the exits of a word with locals
+    {
+	cell *p;
+
+	if (!locals_active())
+	    goto next;
+	for (p = locals.start; p < (cell*)sys.dp; p++) {
+	    if (*p == C(semi))
+		*p = C(exit_locals);
+	    else if (has_operand(*p, dict))
+		p++;
+	}
+	COMMA(C(exit_locals), cell);
+	locals.count = 0;
+	goto next;
+    }
 
 // ---------------------------------------------------------------------------
 // Stack
@@ -682,8 +2490,10 @@ cmove: // ( from to u -- )
 fill: // ( addr u char -- )
     memset((char*)sp[2], TOS, NOS); DROP(3); goto next;
 
-malloc: FUNC1(malloc(TOS));      // ( n -- addr )
-free:   PROC1(free((void*)TOS)); // ( addr -- )
+malloc: FUNC1(stats_malloc(TOS));      // ( n -- addr )
+free:   PROC1(stats_free((void*)TOS)); // ( addr -- )
+free_at_marker: // free-at-marker ( addr -- flag )
+    FUNC1(BOOL(marker_register((void*)TOS)));
 
 per_cell:  FUNC0(sizeof(cell));       // /cell ( -- n )
 cellplus:  FUNC1(TOS + sizeof(cell)); // cell+ ( n -- n' )
@@ -691,6 +2501,7 @@ cellminus: FUNC1(TOS - sizeof(cell)); // cell- ( n -- n' )
 
 strchr: FUNC2(strchr((char*)NOS, TOS)); // ( str char -- addr )
 strlen: FUNC1(strlen((char*)TOS));      // ( str -- # )
+str_equal: FUNC2(BOOL(!strcmp((char*)NOS, (char*)TOS))); // str= ( str1 str2 -- flag )
 
 // ---------------------------------------------------------------------------
 // Input/Output
@@ -717,6 +2528,29 @@ gets: // ( a n -- a' )
 puts: // ( a -- )               print null-terminated string
     PROC1(fputs((char*)TOS, stdout));
 
+base:   FUNC0(&sys.base);         // ( -- addr )
+
+udot_paren: // (u.) ( u -- str )
+    {
+	static char buf[FORMAT_SIZE + 1];
+
+	FUNC1(format_number(buf + FORMAT_SIZE, TOS, sys.base, 0));
+    }
+
+dot_paren: // (.) ( n -- str )
+    {
+	static char buf[FORMAT_SIZE + 1];
+
+	FUNC1(format_number(buf + FORMAT_SIZE, TOS, sys.base, 1));
+    }
+
+dot_cells: // .cells ( addr n -- )
+    {
+	format_cells((cell*)NOS, TOS, sys.base);
+	DROP(2);
+	goto next;
+    }
+
 uhdot: // uh. ( n -- )		print unsigned hexadecimal
     PROC1(printf("%"PRIxCELL" ", TOS));
 
@@ -725,6 +2559,104 @@ num_eol: FUNC0('\n');		// #eol ( -- char )
 num_eof: FUNC0(EOF);		// #eof ( -- char )
 whitespace: FUNC0("\n\t ");
 
+// ---------------------------------------------------------------------------
+// C interface
+
+library: // ( str -- handle )
+    FUNC1(dlopen((char*)TOS, RTLD_LAZY | RTLD_GLOBAL));
+c_symbol: // c-symbol ( handle str -- addr )
+    FUNC2(dlsym((void*)NOS, (char*)TOS));
+
+c_stub: // c-stub ( str -- addr | 0 )   call stub for a signature
+    {
+	static label_t stubs[2][MAX_C_ARGS + 1] = {
+	    { &&call_v0, &&call_v1, &&call_v2, &&call_v3,
+	      &&call_v4, &&call_v5, &&call_v6 },
+	    { &&call_0, &&call_1, &&call_2, &&call_3,
+	      &&call_4, &&call_5, &&call_6 } };
+	int args, results;
+
+	if (!c_signature((char*)TOS, &args, &results)) {
+	    FUNC1(0);
+	}
+	FUNC1(stubs[results][args]);
+    }
+
+// Call stubs, one for each signature. The address of the C function
+// is in the first cell of the body.
+#define CALL(type, ...)  ((type (*)())FROM_XT(w)->body[0])(__VA_ARGS__)
+
+call_0: FUNCN(0, CALL(cell));
+call_1: FUNCN(1, CALL(cell, TOS));
+call_2: FUNCN(2, CALL(cell, NOS, TOS));
+call_3: FUNCN(3, CALL(cell, sp[2], NOS, TOS));
+call_4: FUNCN(4, CALL(cell, sp[3], sp[2], NOS, TOS));
+call_5: FUNCN(5, CALL(cell, sp[4], sp[3], sp[2], NOS, TOS));
+call_6: FUNCN(6, CALL(cell, sp[5], sp[4], sp[3], sp[2], NOS, TOS));
+
+call_v0: PROCN(0, CALL(void));
+call_v1: PROCN(1, CALL(void, TOS));
+call_v2: PROCN(2, CALL(void, NOS, TOS));
+call_v3: PROCN(3, CALL(void, sp[2], NOS, TOS));
+call_v4: PROCN(4, CALL(void, sp[3], sp[2], NOS, TOS));
+call_v5: PROCN(5, CALL(void, sp[4], sp[3], sp[2], NOS, TOS));
+call_v6: PROCN(6, CALL(void, sp[5], sp[4], sp[3], sp[2], NOS, TOS));
+
+// ---------------------------------------------------------------------------
+// Compiler to C
+
+compile_to_c: // (compile-to-c) ( xt str -- )
+    {
+	static routine_t routines[] = {
+	    { "docol", (cell)&&docol },
+	    { "dodefer", (cell)&&dodefer },
+	    { "dovar", (cell)&&dovar },
+	    { "dodoes", (cell)&&dodoes },
+	    { "call_0", (cell)&&call_0 }, { "call_1", (cell)&&call_1 },
+	    { "call_2", (cell)&&call_2 }, { "call_3", (cell)&&call_3 },
+	    { "call_4", (cell)&&call_4 }, { "call_5", (cell)&&call_5 },
+	    { "call_6", (cell)&&call_6 },
+	    { "call_v0", (cell)&&call_v0 }, { "call_v1", (cell)&&call_v1 },
+	    { "call_v2", (cell)&&call_v2 }, { "call_v3", (cell)&&call_v3 },
+	    { "call_v4", (cell)&&call_v4 }, { "call_v5", (cell)&&call_v5 },
+	    { "call_v6", (cell)&&call_v6 },
+	};
+	static aot_kernel_t kernel = {
+	    .dict = dict,
+	    .num_words = num_words,
+	    .labels = word_labels,
+	    .routines = routines,
+	    .num_routines = sizeof(routines) / sizeof(routine_t),
+	    .mem = (cell)sys.mem,
+	    .sys = (cell)&sys,
+	    .per_sys = sizeof(sys),
+	    .docol = (cell)&&docol,
+	    .dodefer = (cell)&&dodefer,
+	    .lit = C(lit),
+	    .branch = C(branch),
+	    .zbranch = C(zbranch),
+	    .tail_call = C(tail_call),
+	    .semi = C(semi),
+	    .if_semi = C(if_semi),
+	    .zero_semi = C(zero_semi),
+	    .rpstore = C(rpstore),
+	    .locals = C(locals_),
+	    .local_fetch = C(local_fetch),
+	    .local_store = C(local_store),
+	    .exit_locals = C(exit_locals),
+	};
+
+	kernel.last = sys.root.last;
+	kernel.here = sys.dp;
+#ifdef TOKENS
+	// The compiler reads only threaded code.
+	errno = ENOSYS;
+	DROP(2);
+	goto next;
+#endif
+	PROC2(compile_to_c(&kernel, NOS, (char*)TOS));
+    }
+
 // ---------------------------------------------------------------------------
 // Others
 
@@ -738,5 +2670,7 @@ dotparen: // : .(   here " )" parse-to  here puts ;
 int main(int argc, char *argv[])
 {
     init_args(argc, argv);
+    if (args.client)
+	return client_run((char*)args.client, (char*)args.command);
     mind();
 }
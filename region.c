@@ -0,0 +1,169 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains persistent memory regions. A region is a file
+// that is mapped into memory with MAP_SHARED, so that its content
+// survives the process and is visible to other processes that map
+// the same file.
+//
+// Memory is allocated from the region with a bump allocator; the
+// offset of the free space is in the header and is advanced with a
+// compare-and-swap, so that processes can allocate concurrently.
+// Nothing is ever freed.
+//
+// The size in the header grows when a process opens the region with
+// a larger size. The other processes then extend their mappings in
+// place before they allocate the new space, so that addresses in the
+// region stay valid.
+
+#define _GNU_SOURCE             // for mremap()
+
+#include "region.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define REGION_MAGIC  0x6d696e6472656731 // "mindreg1"
+
+// Map the file *path* as a region of at least *size* bytes. The file
+// is created or extended if necessary; a file that is neither empty
+// nor a region is not touched. The file is locked while it is
+// checked and set up, so that only one process writes the header of
+// a new region. Returns NULL on error, with errno set.
+region_t *region_open(char *path, cell size)
+{
+    struct stat st;
+    region_header_t *h;
+    region_t *r;
+    cell magic;
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0666)) < 0)
+	return NULL;
+    if (flock(fd, LOCK_EX) < 0 || fstat(fd, &st) < 0)
+	goto fail;
+    if (st.st_size > 0
+	&& (pread(fd, &magic, sizeof(cell), 0) != sizeof(cell)
+	    || magic != (cell)REGION_MAGIC)) {
+	errno = EINVAL;
+	goto fail;
+    }
+    if (st.st_size > size)
+	size = st.st_size;
+    if (size < (cell)sizeof(region_header_t)) {
+	errno = EINVAL;
+	goto fail;
+    }
+    if (st.st_size < size && ftruncate(fd, size) < 0)
+	goto fail;
+    if (!(r = malloc(sizeof(region_t))))
+	goto fail;
+
+    h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) {
+	free(r);
+	goto fail;
+    }
+    r->base = h;
+    r->length = size;
+
+    if (st.st_size == 0) {
+	h->size = size;
+	h->top = sizeof(region_header_t);
+	h->root = 0;
+	__atomic_store_n(&h->magic, (cell)REGION_MAGIC, __ATOMIC_SEQ_CST);
+    } else {
+	cell old = h->size;
+
+	// Only grow: another process may have grown it further.
+	while (old < size
+	       && !__atomic_compare_exchange_n(&h->size, &old, size, 0,
+					       __ATOMIC_SEQ_CST,
+					       __ATOMIC_SEQ_CST))
+	    ;
+    }
+    // The mapping keeps the file open, and with it the lock.
+    flock(fd, LOCK_UN);
+    close(fd);
+    errno = 0;
+    return r;
+
+fail:
+    close(fd);
+    return NULL;
+}
+
+void region_close(region_t *r)
+{
+    munmap(r->base, r->length);
+    free(r);
+}
+
+// Extend the mapping of *r* to the size in its header. The mapping is
+// not moved, since there may be addresses into it. Returns 0 if it
+// cannot be extended.
+int region_update(region_t *r)
+{
+    cell size = __atomic_load_n(&r->base->size, __ATOMIC_SEQ_CST);
+
+    if (size <= r->length)
+	return 1;
+    if (mremap(r->base, r->length, size, 0) == MAP_FAILED)
+	return 0;
+    r->length = size;
+    return 1;
+}
+
+// Reserve *n* bytes, aligned to a cell. Returns the offset of the
+// space, or 0 if the region is full or cannot be extended in this
+// process. The free space only moves when the allocation fits, so
+// that concurrent allocations never overlap.
+cell region_allot(region_t *r, cell n)
+{
+    cell offset = __atomic_load_n(&r->base->top, __ATOMIC_SEQ_CST);
+
+    n = (n + sizeof(cell) - 1) & ~(cell)(sizeof(cell) - 1);
+    do {
+	if (offset + n > r->length
+	    && !(region_update(r) && offset + n <= r->length))
+	    return 0;
+    } while (!__atomic_compare_exchange_n(&r->base->top, &offset,
+					  offset + n, 0, __ATOMIC_SEQ_CST,
+					  __ATOMIC_SEQ_CST));
+    return offset;
+}
+
+// Offset of the main object of the region. If there is none yet, a
+// new one with *size* bytes is allocated. Returns 0 if the region is
+// full.
+cell region_main(region_t *r, cell size)
+{
+    cell old = 0, offset;
+
+    if (r->base->root)
+	return region_update(r) ? r->base->root : 0;
+    if (!(offset = region_allot(r, size)))
+	return 0;
+    // Another process may have been faster; then its object is used
+    // and our space is lost.
+    if (__atomic_compare_exchange_n(&r->base->root, &old, offset, 0,
+				    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+	return offset;
+    return old;
+}
+
+// Write the region back to its file. Returns 0 on success.
+int region_commit(region_t *r)
+{
+    return msync(r->base, r->length, MS_SYNC);
+}
@@ -0,0 +1,41 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains persistent memory regions: files that are mapped
+// into memory and shared between processes.
+
+#ifndef REGION_H
+#define REGION_H
+
+#include "types.h"
+
+// Start of every region. Inside a region, pointers are stored as
+// offsets from its start, since it is mapped at a different address
+// in each process.
+typedef struct {
+    cell magic;
+    cell size;                  // Size of the region in bytes
+    cell top;                   // Offset of the free space
+    cell root;                  // Offset of the main object, or 0
+} region_header_t;
+
+// A region as it is mapped in this process. Another process may have
+// extended the file since, so `length` can be smaller than the size
+// in the header.
+typedef struct {
+    region_header_t *base;      // Start of the mapping
+    cell length;                // Length of the mapping in bytes
+} region_t;
+
+region_t *region_open(char *path, cell size);
+void region_close(region_t *r);
+int region_update(region_t *r);
+cell region_allot(region_t *r, cell n);
+cell region_main(region_t *r, cell size);
+int region_commit(region_t *r);
+
+#endif
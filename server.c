@@ -0,0 +1,149 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the command server and its client.
+//
+// The server is started after the system is booted and has loaded its
+// libraries. It listens on a Unix domain socket and keeps a pool of
+// children, created by `fork`, that wait for a connection. A child
+// that receives one handles a single request with the connection as
+// its standard input and output, and then exits; the server replaces
+// it as soon as it has accepted the connection. The children share the memory of the server until they write
+// to it, so a request costs neither the start of a process nor the
+// bootstrap of the language.
+//
+// The client sends a command, closes its side of the connection, and
+// copies the reply to its standard output.
+
+#include "server.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+static int socket_address(struct sockaddr_un *addr, char *path)
+{
+    if (strlen(path) >= sizeof(addr->sun_path))
+	return -1;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// Listen on the socket *path*. Returns the file descriptor or -1.
+int server_open(char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (socket_address(&addr, path) < 0
+	|| (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+	|| listen(fd, SOMAXCONN) < 0) {
+	close(fd);
+	return -1;
+    }
+    return fd;
+}
+
+// Keep *pool* children waiting for a connection on *fd*. A child
+// tells the server through a pipe when its `accept` returns, and the
+// server then replaces it at once, so that busy children do not take
+// the place of waiting ones. Returns 0 in a child that has accepted a
+// connection, with the connection as its standard input, output and
+// error output. The server itself only returns on an error, with -1;
+// the waiting children end with it.
+int server_fork(int fd, cell pool)
+{
+    cell waiting = 0;
+    int accepted[2];
+    pid_t pid;
+    int conn;
+    char c;
+
+    if (pipe(accepted) < 0)
+	return -1;
+    fflush(stdout);
+    fflush(stderr);
+    for (;;) {
+	while (waiting < pool) {
+	    if ((pid = fork()) < 0)
+		return -1;
+	    if (pid == 0) {
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+		conn = accept(fd, NULL, NULL);
+		if (write(accepted[1], "", 1) != 1 || conn < 0)
+		    _exit(1);
+		close(accepted[0]);
+		close(accepted[1]);
+		close(fd);
+		dup2(conn, 0);
+		dup2(conn, 1);
+		dup2(conn, 2);
+		close(conn);
+		clearerr(stdin);
+		return 0;
+	    }
+	    waiting++;
+	}
+	if (read(accepted[0], &c, 1) == 1)
+	    waiting--;
+	else if (errno != EINTR)
+	    return -1;
+	// Collect the children that have finished.
+	while (waitpid(-1, NULL, WNOHANG) > 0)
+	    ;
+    }
+}
+
+static int copy_fd(int from, int to)
+{
+    char buf[4096];
+    ssize_t n;
+
+    while ((n = read(from, buf, sizeof(buf))) > 0)
+	if (write(to, buf, n) != n)
+	    return -1;
+    return n;
+}
+
+// Send *command*, or the standard input if it is NULL, to the server
+// at *path* and copy the reply to the standard output. Returns the
+// exit status of the client.
+int client_run(char *path, char *command)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (socket_address(&addr, path) < 0
+	|| (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+	|| connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+	perror(path);
+	return 1;
+    }
+    if (command) {
+	size_t n = strlen(command);
+
+	if (write(fd, command, n) != (ssize_t)n || write(fd, "\n", 1) != 1)
+	    return 1;
+    } else if (copy_fd(0, fd) < 0)
+	return 1;
+    shutdown(fd, SHUT_WR);
+    if (copy_fd(fd, 1) < 0)
+	return 1;
+    close(fd);
+    return 0;
+}
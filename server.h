@@ -0,0 +1,19 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the command server and its client.
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "types.h"
+
+int server_open(char *path);
+int server_fork(int fd, cell pool);
+int client_run(char *path, char *command);
+
+#endif
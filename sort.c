@@ -0,0 +1,238 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the sorting of arrays.
+//
+// Arrays of cells and records with a cell key are sorted by an LSD
+// radix sort, one byte per pass. The histograms of all passes are
+// computed in a single scan, and passes in which all keys have the
+// same byte are skipped. The radix sort is stable.
+//
+// Arrays with a comparison in Forth are sorted by a quicksort with a
+// median of three, insertion sort for short ranges and heapsort when
+// too many partitions are unbalanced. It is written as a coroutine:
+// the state is kept in a structure, and `sortby_step` returns to the
+// interpreter for each comparison.
+
+#include "sort.h"
+
+#include <string.h>
+
+#define BYTES  ((int)sizeof(cell))
+#define SIGN   ((ucell)1 << (BYTES * 8 - 1))
+
+// Key of record *i*, as an unsigned number in the sort order
+static inline ucell record_key(char *base, cell i, cell size, cell offset,
+			       ucell flip)
+{
+    ucell k;
+
+    memcpy(&k, base + i * size + offset, sizeof(ucell));
+    return k ^ flip;
+}
+
+// Sort *n* records of *size* bytes at *base* by the cell at *offset*
+// in each record. Cells are sorted with size = sizeof(cell) and
+// offset = 0.
+static void radix(char *base, cell n, cell size, cell offset, ucell flip)
+{
+    cell (*count)[256] = calloc(BYTES, sizeof(*count));
+    char *tmp = malloc(n * size);
+    char *src = base, *dst = tmp;
+    cell i, pass;
+
+    for (i = 0; i < n; i++) {
+	ucell k = record_key(base, i, size, offset, flip);
+
+	for (pass = 0; pass < BYTES; pass++, k >>= 8)
+	    count[pass][k & 0xff]++;
+    }
+
+    for (pass = 0; pass < BYTES; pass++) {
+	cell *c = count[pass], sum = 0, b;
+
+	if (c[record_key(src, 0, size, offset, flip) >> (pass * 8) & 0xff] == n)
+	    continue;           // All keys have the same byte
+	for (b = 0; b < 256; b++) {
+	    cell t = c[b];
+
+	    c[b] = sum;
+	    sum += t;
+	}
+	if (size == sizeof(cell)) {
+	    ucell *s = (ucell*)src, *d = (ucell*)dst;
+
+	    for (i = 0; i < n; i++)
+		d[c[(s[i] ^ flip) >> (pass * 8) & 0xff]++] = s[i];
+	} else
+	    for (i = 0; i < n; i++) {
+		ucell k = record_key(src, i, size, offset, flip);
+
+		memcpy(dst + c[k >> (pass * 8) & 0xff]++ * size,
+		       src + i * size, size);
+	    }
+	char *t = src; src = dst; dst = t;
+    }
+
+    if (src != base)
+	memcpy(base, src, n * size);
+    free(tmp);
+    free(count);
+}
+
+void radix_sort(cell *v, cell n, int is_signed)
+{
+    if (n > 1)
+	radix((char*)v, n, sizeof(cell), 0, is_signed ? SIGN : 0);
+}
+
+void sort_records(char *base, cell n, cell size, cell offset)
+{
+    if (n > 1)
+	radix(base, n, size, offset, SIGN);
+}
+
+sortby_t *sortby_new(cell *v, cell n)
+{
+    sortby_t *s = calloc(1, sizeof(sortby_t));
+    cell bits = 0;
+
+    s->v = v;
+    while (n >> bits)
+	bits++;
+    s->bad = bits;
+    s->stack[s->sp++] = 0;
+    s->stack[s->sp++] = n;
+    return s;
+}
+
+// Ask for a comparison of x and y; `s->less` is the answer when the
+// next line is reached.
+#define LESS(x, y)							\
+    do { s->a = (x); s->b = (y); s->pc = __LINE__; return 1;		\
+	case __LINE__:; } while (0)
+
+#define SWAP(p, q)  do { cell t = v[p]; v[p] = v[q]; v[q] = t; } while (0)
+
+#define INSERTION_MAX  16
+
+// Continue the sort. Returns true if s->a and s->b must be compared,
+// false if the array is sorted.
+int sortby_step(sortby_t *s)
+{
+    cell *v = s->v;
+
+    switch (s->pc) {
+    case 0:
+	while (s->sp) {
+	    s->hi = s->stack[--s->sp];
+	    s->lo = s->stack[--s->sp];
+
+	    if (s->hi - s->lo <= INSERTION_MAX) {
+		for (s->i = s->lo + 1; s->i < s->hi; s->i++) {
+		    s->x = v[s->i];
+		    for (s->j = s->i; s->j > s->lo; s->j--) {
+			LESS(s->x, v[s->j - 1]);
+			if (!s->less)
+			    break;
+			v[s->j] = v[s->j - 1];
+		    }
+		    v[s->j] = s->x;
+		}
+		continue;
+	    }
+
+	    if (s->bad < 0) {
+		// Heapsort of the range, with the heap at v[lo]
+		s->k = (s->hi - s->lo) / 2;
+		s->end = s->hi - s->lo;
+		for (;;) {
+		    if (s->k > 0)
+			s->r = --s->k;
+		    else {
+			if (--s->end <= 0)
+			    break;
+			SWAP(s->lo, s->lo + s->end);
+			s->r = 0;
+		    }
+		    while ((s->c = 2 * s->r + 1) < s->end) {
+			if (s->c + 1 < s->end) {
+			    LESS(v[s->lo + s->c], v[s->lo + s->c + 1]);
+			    if (s->less)
+				s->c++;
+			}
+			LESS(v[s->lo + s->r], v[s->lo + s->c]);
+			if (!s->less)
+			    break;
+			SWAP(s->lo + s->r, s->lo + s->c);
+			s->r = s->c;
+		    }
+		}
+		continue;
+	    }
+
+	    // Median of three as the pivot, moved to v[lo]
+	    s->m = s->lo + (s->hi - s->lo) / 2;
+	    LESS(v[s->m], v[s->lo]);
+	    if (s->less)
+		SWAP(s->m, s->lo);
+	    LESS(v[s->hi - 1], v[s->m]);
+	    if (s->less) {
+		SWAP(s->hi - 1, s->m);
+		LESS(v[s->m], v[s->lo]);
+		if (s->less)
+		    SWAP(s->m, s->lo);
+	    }
+	    SWAP(s->lo, s->m);
+	    s->x = v[s->lo];
+
+	    // Partition: v[lo+1..i) <= pivot, v(j..hi) >= pivot
+	    s->i = s->lo + 1;
+	    s->j = s->hi - 1;
+	    for (;;) {
+		while (s->i <= s->j) {
+		    LESS(v[s->i], s->x);
+		    if (!s->less)
+			break;
+		    s->i++;
+		}
+		while (s->i <= s->j) {
+		    LESS(s->x, v[s->j]);
+		    if (!s->less)
+			break;
+		    s->j--;
+		}
+		if (s->i >= s->j)
+		    break;
+		SWAP(s->i, s->j);
+		s->i++;
+		s->j--;
+	    }
+	    SWAP(s->lo, s->j);
+
+	    // The smaller part is sorted first, so the stack stays short.
+	    {
+		cell left = s->j - s->lo, right = s->hi - s->j - 1;
+
+		if ((left < right ? left : right) < (s->hi - s->lo) / 8)
+		    s->bad--;
+		if (left < right) {
+		    s->stack[s->sp++] = s->j + 1;
+		    s->stack[s->sp++] = s->hi;
+		    s->stack[s->sp++] = s->lo;
+		    s->stack[s->sp++] = s->j;
+		} else {
+		    s->stack[s->sp++] = s->lo;
+		    s->stack[s->sp++] = s->j;
+		    s->stack[s->sp++] = s->j + 1;
+		    s->stack[s->sp++] = s->hi;
+		}
+	    }
+	}
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the sorting of arrays.
+
+#ifndef SORT_H
+#define SORT_H
+
+#include "types.h"
+
+#define SORT_STACK  128         // Ranges waiting to be sorted, times 2
+
+// State of a sort with a comparison in Forth. The comparison cannot
+// be called from C; instead, `sortby_step` returns whenever it needs
+// one, and is called again with the result.
+typedef struct {
+    cell thread[2];             // Forth code: comparison, then resume
+    cell *v;                    // The array
+    cell a, b;                  // Values to compare
+    cell less;                  // flag: a comes before b
+    cell pc;                    // Where `sortby_step` resumes
+
+    cell lo, hi;                // Current range
+    cell i, j, m, x;
+    cell bad;                   // Unbalanced partitions before heapsort
+    cell k, end, r, c;          // Heapsort
+    cell sp;
+    cell stack[SORT_STACK];
+} sortby_t;
+
+void radix_sort(cell *v, cell n, int is_signed);
+void sort_records(char *base, cell n, cell size, cell offset);
+
+sortby_t *sortby_new(cell *v, cell n);
+int sortby_step(sortby_t *s);
+
+#endif
@@ -0,0 +1,403 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the runtime metrics.
+//
+// Counting every executed word would make the inner interpreter much
+// slower, so `next` counts nothing. `calls_total` only counts the
+// calls of colon definitions and does> words, in the runtimes
+// `docol` and `dodoes`, which already do more work per call. The
+// other counters are changed at events like `find` or `malloc`.
+//
+// The dictionary space of each file that is read is kept as the
+// pieces of the dictionary that it compiled itself, without those of
+// the files that it read in turn, so that `forget` can cut them back
+// to the new end of the dictionary. Memory from `malloc` is measured
+// with malloc_usable_size, so that `free` can subtract the same
+// amount.
+//
+// The peak depths of the stacks cost nothing while the program runs:
+// the stack areas are filled with STATS_CANARY at the start, and the
+// deepest cell that was overwritten is searched when the metrics are
+// read.
+
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+stats_t stats;
+
+// Dictionary bytes of the files that were read, the pieces of the
+// dictionary that they compiled, and the files that are being read.
+// The writer thread reads them too.
+typedef struct {
+    char *name;
+    cell bytes;                 // Sum of the pieces of the file
+} file_usage_t;
+
+typedef struct {
+    cell index;                 // Entry in `files.v`
+    cell from, to;              // Range of the dictionary
+} file_piece_t;
+
+static struct {
+    file_usage_t *v;
+    cell count, size;
+    file_piece_t *pieces;
+    cell num_pieces, pieces_size;
+    struct {
+	cell index;             // Entry in `v`
+	cell start;             // Start of the current piece
+    } open[STATS_NESTING];
+    cell depth;
+    pthread_mutex_t lock;
+} files = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// Monotonic time in nanoseconds
+cell stats_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (cell)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void paint(cell *from, cell *to)
+{
+    for (; from < to; from++)
+	*from = STATS_CANARY;
+}
+
+// Number of cells between *base* and the deepest overwritten cell
+static cell peak(cell *limit, cell *base)
+{
+    cell *p;
+
+    for (p = base; p > limit && p[-1] != STATS_CANARY; p--)
+	;
+    return base - p;
+}
+
+void stats_init(stats_env_t *env)
+{
+    paint(env->stack_limit, env->s0);
+    paint(env->rstack, env->r0);
+    paint(env->ostack, env->op0);
+}
+
+void *stats_malloc(size_t n)
+{
+    void *p = malloc(n);
+
+    stats.mallocs++;
+    stats.malloc_bytes += n;
+    if (p) {
+	stats.malloc_live += malloc_usable_size(p);
+	if (stats.malloc_live > stats.malloc_peak)
+	    stats.malloc_peak = stats.malloc_live;
+    }
+    return p;
+}
+
+void stats_free(void *p)
+{
+    if (p)
+	stats.malloc_live -= malloc_usable_size(p);
+    free(p);
+}
+
+// ---------------------------------------------------------------------------
+// Dictionary space per file
+
+static cell file_index(char *name)
+{
+    cell i;
+
+    for (i = 0; i < files.count; i++)
+	if (!strcmp(files.v[i].name, name))
+	    return i;
+    if (files.count == files.size) {
+	files.size = files.size ? 2 * files.size : 16;
+	files.v = realloc(files.v, files.size * sizeof(file_usage_t));
+    }
+    files.v[i] = (file_usage_t) { strdup(name), 0 };
+    files.count++;
+    return i;
+}
+
+// File *i* compiled the dictionary from *from* to *to*.
+static void add_piece(cell i, cell from, cell to)
+{
+    file_piece_t *last;
+
+    if (to <= from)
+	return;
+    files.v[i].bytes += to - from;
+    last = files.num_pieces ? &files.pieces[files.num_pieces - 1] : NULL;
+    if (last && last->index == i && last->to == from) {
+	last->to = to;
+	return;
+    }
+    if (files.num_pieces == files.pieces_size) {
+	files.pieces_size = files.pieces_size ? 2 * files.pieces_size : 16;
+	files.pieces = realloc(files.pieces,
+			       files.pieces_size * sizeof(file_piece_t));
+    }
+    files.pieces[files.num_pieces++] = (file_piece_t) { i, from, to };
+}
+
+// The file *name* is read, starting with the dictionary pointer *dp*.
+// The piece of the file that reads it ends here.
+void stats_file_start(char *name, cell dp)
+{
+    pthread_mutex_lock(&files.lock);
+    if (files.depth < STATS_NESTING) {
+	if (files.depth > 0)
+	    add_piece(files.open[files.depth - 1].index,
+		      files.open[files.depth - 1].start, dp);
+	files.open[files.depth].index = file_index(name);
+	files.open[files.depth].start = dp;
+    }
+    files.depth++;
+    pthread_mutex_unlock(&files.lock);
+}
+
+static void file_end(cell dp)
+{
+    if (--files.depth >= STATS_NESTING)
+	return;
+    add_piece(files.open[files.depth].index,
+	      files.open[files.depth].start, dp);
+    if (files.depth > 0)
+	files.open[files.depth - 1].start = dp;
+}
+
+// The newest file that is read is finished.
+void stats_file_end(cell dp)
+{
+    pthread_mutex_lock(&files.lock);
+    if (files.depth > 0)
+	file_end(dp);
+    pthread_mutex_unlock(&files.lock);
+}
+
+// An abort left all files; what they compiled so far counts.
+void stats_file_abort(cell dp)
+{
+    pthread_mutex_lock(&files.lock);
+    while (files.depth > 0)
+	file_end(dp);
+    pthread_mutex_unlock(&files.lock);
+}
+
+// The dictionary was cut back to *dp*: the pieces above it no longer
+// count, and the files that are still read continue at *dp*.
+void stats_file_forget(cell dp)
+{
+    cell i, n = 0;
+
+    pthread_mutex_lock(&files.lock);
+    for (i = 0; i < files.num_pieces; i++) {
+	file_piece_t *p = &files.pieces[i];
+
+	if (p->to > dp) {
+	    cell to = p->from > dp ? p->from : dp;
+
+	    files.v[p->index].bytes -= p->to - to;
+	    p->to = to;
+	}
+	if (p->to > p->from)
+	    files.pieces[n++] = *p;
+    }
+    files.num_pieces = n;
+    for (i = 0; i < files.depth && i < STATS_NESTING; i++)
+	if (files.open[i].start > dp)
+	    files.open[i].start = dp;
+    pthread_mutex_unlock(&files.lock);
+}
+
+// Bytes of file *i*, including the piece that is still compiled
+static cell file_bytes(cell i, cell dp)
+{
+    cell d = files.depth < STATS_NESTING ? files.depth : STATS_NESTING;
+
+    if (d > 0 && files.open[d - 1].index == i)
+	return files.v[i].bytes + dp - files.open[d - 1].start;
+    return files.v[i].bytes;
+}
+
+// Dictionary bytes of the file *name*, or 0 if it was not read
+cell stats_file_bytes(char *name, cell dp)
+{
+    cell i, bytes = 0;
+
+    pthread_mutex_lock(&files.lock);
+    for (i = 0; i < files.count; i++)
+	if (!strcmp(files.v[i].name, name))
+	    bytes = file_bytes(i, dp);
+    pthread_mutex_unlock(&files.lock);
+    return bytes;
+}
+
+typedef struct {
+    const char *name;
+    const char *help;
+    cell value;
+} metric_t;
+
+#define NUM_METRICS  18
+
+static void collect(stats_env_t *env, metric_t m[NUM_METRICS])
+{
+    stats_t s = stats;
+    metric_t all[NUM_METRICS] = {
+	{ "calls_total", "Calls of colon definitions and does> words",
+	  s.calls },
+	{ "finds_total", "Dictionary searches", s.finds },
+	{ "find_hits_total", "Successful dictionary searches", s.find_hits },
+	{ "parsed_bytes_total", "Bytes in the names searched",
+	  s.parsed_bytes },
+	{ "read_bytes_total", "Bytes read by file and line streams",
+	  s.read_bytes },
+	{ "mallocs_total", "Calls of malloc", s.mallocs },
+	{ "malloc_bytes_total", "Bytes allocated by malloc",
+	  s.malloc_bytes },
+	{ "malloc_live_bytes", "Bytes allocated by malloc and not freed",
+	  s.malloc_live },
+	{ "malloc_peak_bytes", "Peak of the bytes allocated and not freed",
+	  s.malloc_peak },
+	{ "aborts_total", "Calls of abort", s.aborts },
+	{ "abort_nanoseconds_total", "Time spent in abort",
+	  s.abort_ns },
+	{ "dictionary_bytes", "Bytes used by the dictionary",
+	  *env->dp - (cell)env->mem },
+	{ "memory_bytes", "Size of the main memory",
+	  (env->mem_end - env->mem) * (cell)sizeof(cell) },
+	{ "stack_peak_cells", "Peak depth of the parameter stack",
+	  peak(env->stack_limit, env->s0) },
+	{ "rstack_peak_cells", "Peak depth of the return stack",
+	  peak(env->rstack, env->r0) },
+	{ "rstack_cells", "Size of the return stack", env->r0 - env->rstack },
+	{ "ostack_peak_cells", "Peak depth of the object stack",
+	  peak(env->ostack, env->op0) },
+	{ "ostack_cells", "Size of the object stack", env->op0 - env->ostack },
+    };
+
+    memcpy(m, all, sizeof(all));
+}
+
+// The metrics for humans, used by `.stats`
+void stats_print(FILE *out, stats_env_t *env)
+{
+    metric_t m[NUM_METRICS];
+    int i;
+
+    collect(env, m);
+    for (i = 0; i < NUM_METRICS; i++)
+	fprintf(out, "%-22s %14"PRIdCELL"  %s\n",
+		m[i].name, m[i].value, m[i].help);
+    fflush(out);
+}
+
+// The report of `.memory`: the use of the dictionary, by file, and
+// of the stacks and `malloc`.
+void stats_print_memory(FILE *out, stats_env_t *env)
+{
+    cell used = *env->dp - (cell)env->mem;
+    cell size = (env->mem_end - env->mem) * (cell)sizeof(cell);
+    cell rest = used;
+    cell i;
+
+    fprintf(out, "dictionary     %10"PRIdCELL" of %10"PRIdCELL" bytes\n",
+	    used, size);
+    pthread_mutex_lock(&files.lock);
+    for (i = 0; i < files.count; i++) {
+	cell bytes = file_bytes(i, *env->dp);
+
+	fprintf(out, "  %10"PRIdCELL"  %s\n", bytes, files.v[i].name);
+	rest -= bytes;
+    }
+    pthread_mutex_unlock(&files.lock);
+    fprintf(out, "  %10"PRIdCELL"  (init.mind and other)\n", rest);
+    fprintf(out, "stack peak     %10"PRIdCELL" of %10"PRIdCELL" cells\n",
+	    peak(env->stack_limit, env->s0), (cell)STATS_STACK);
+    fprintf(out, "rstack peak    %10"PRIdCELL" of %10"PRIdCELL" cells\n",
+	    peak(env->rstack, env->r0), (cell)(env->r0 - env->rstack));
+    fprintf(out, "ostack peak    %10"PRIdCELL" of %10"PRIdCELL" cells\n",
+	    peak(env->ostack, env->op0), (cell)(env->op0 - env->ostack));
+    fprintf(out, "malloc live    %10"PRIdCELL" bytes, peak %"PRIdCELL"\n",
+	    stats.malloc_live, stats.malloc_peak);
+    fflush(out);
+}
+
+// Write the metrics in the Prometheus text format. The file is
+// replaced at once, so that a reader never sees half of it. Returns
+// 0 on success.
+int stats_write(char *path, stats_env_t *env)
+{
+    char *tmp = malloc(strlen(path) + sizeof(".tmp"));
+    metric_t m[NUM_METRICS];
+    FILE *f;
+    int i, err;
+
+    sprintf(tmp, "%s.tmp", path);
+    if (!(f = fopen(tmp, "w"))) {
+	free(tmp);
+	return -1;
+    }
+    collect(env, m);
+    for (i = 0; i < NUM_METRICS; i++) {
+	int counter = strstr(m[i].name, "_total") != NULL;
+
+	fprintf(f, "# HELP mind_%s %s\n", m[i].name, m[i].help);
+	fprintf(f, "# TYPE mind_%s %s\n", m[i].name,
+		counter ? "counter" : "gauge");
+	fprintf(f, "mind_%s %"PRIdCELL"\n", m[i].name, m[i].value);
+    }
+    pthread_mutex_lock(&files.lock);
+    if (files.count) {
+	fprintf(f, "# HELP mind_file_dictionary_bytes "
+		"Bytes of the dictionary compiled by a file\n");
+	fprintf(f, "# TYPE mind_file_dictionary_bytes gauge\n");
+    }
+    for (i = 0; i < files.count; i++)
+	fprintf(f, "mind_file_dictionary_bytes{file=\"%s\"} %"PRIdCELL"\n",
+		files.v[i].name, file_bytes(i, *env->dp));
+    pthread_mutex_unlock(&files.lock);
+    err = fclose(f) || rename(tmp, path);
+    free(tmp);
+    return err;
+}
+
+static char *stats_path;
+static stats_env_t *stats_env;
+
+static void *writer(void *arg)
+{
+    (void)arg;
+    for (;;) {
+	sleep(STATS_INTERVAL);
+	stats_write(stats_path, stats_env);
+    }
+    return NULL;
+}
+
+// Write the metrics to *path* every STATS_INTERVAL seconds.
+void stats_start(char *path, stats_env_t *env)
+{
+    pthread_t thread;
+
+    stats_path = path;
+    stats_env = env;
+    if (!pthread_create(&thread, NULL, writer, NULL))
+	pthread_detach(thread);
+}
@@ -0,0 +1,71 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the runtime metrics.
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+#define STATS_INTERVAL  10      // Seconds between two writes of `-m`
+#define STATS_STACK     0x1000  // Cells of the parameter stack measured
+#define STATS_CANARY    ((cell)0x5a5a5a5a5a5a5a5a) // Unused stack cell
+#define STATS_NESTING   32      // Files that are read at the same time
+
+// Counters that are updated while the program runs. Apart from
+// `calls`, they are only changed at events that are rare compared to
+// the execution of words.
+typedef struct {
+    cell calls;                 // Calls of colon definitions and does> words
+    cell finds;                 // Dictionary searches
+    cell find_hits;             // Successful dictionary searches
+    cell parsed_bytes;          // Bytes in the names searched
+    cell read_bytes;            // Bytes read by file and line streams
+    cell mallocs;               // Calls of `malloc`
+    cell malloc_bytes;          // Bytes allocated by `malloc`
+    cell malloc_live;           // Bytes allocated by `malloc` and not freed
+    cell malloc_peak;           // Maximum of `malloc_live`
+    cell aborts;                // Calls of `abort`
+    cell abort_ns;              // Time between `abort` and the restart
+    cell abort_start;           // Time of the last `abort`, or 0
+} stats_t;
+
+// Metrics that are computed when they are read
+typedef struct {
+    cell *dp;                   // (cell*) Address of the dictionary pointer
+    cell *mem;                  // Start of the main memory
+    cell *mem_end;              // End of the main memory
+    cell *stack_limit;          // Deepest measured parameter stack cell
+    cell *s0;                   // Start of the parameter stack
+    cell *rstack;               // Return stack area
+    cell *r0;                   // Start of the return stack
+    cell *ostack;               // Object stack area
+    cell *op0;                  // Start of the object stack
+} stats_env_t;
+
+extern stats_t stats;
+
+cell stats_time(void);
+void stats_init(stats_env_t *env);
+void stats_print(FILE *out, stats_env_t *env);
+int stats_write(char *path, stats_env_t *env);
+void stats_start(char *path, stats_env_t *env);
+
+void *stats_malloc(size_t n);
+void stats_free(void *p);
+
+void stats_file_start(char *name, cell dp);
+void stats_file_end(cell dp);
+void stats_file_abort(cell dp);
+void stats_file_forget(cell dp);
+cell stats_file_bytes(char *name, cell dp);
+void stats_print_memory(FILE *out, stats_env_t *env);
+
+#endif
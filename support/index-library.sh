@@ -0,0 +1,19 @@
+#!/bin/sh
+# mind -- a Forth interpreter
+# Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+#
+# Published under the GNU General Public License version 2 or any
+# later version, at your choice. There is NO WARRANY, not at all. See
+# the file "copying" for details.
+
+# Print an autoload index for library files. Each file is loaded in a
+# fresh process, so that every word is listed under the file that
+# defines it. The index is read with "include".
+#
+# Usage: support/index-library.sh lib/*.mind > lib.index
+
+MIND=${MIND:-./mind}
+
+for f in "$@"; do
+    "$MIND" -e "index-file $(realpath "$f")" </dev/null || exit 1
+done
@@ -0,0 +1,48 @@
+#!/bin/sh
+# mind -- a Forth interpreter
+# Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+#
+# Published under the GNU General Public License version 2 or any
+# later version, at your choice. There is NO WARRANY, not at all. See
+# the file "copying" for details.
+
+# Load test of the command server: runs a command N times with
+# "mind -e" and with "mind -C" against a server started with "mind -S",
+# and prints the percentiles of the latency in microseconds.
+#
+# Usage: support/loadtest.sh [N] [cmd]
+
+MIND=${MIND:-./mind}
+N=${1:-1000}
+CMD=${2:-"1 2 + drop"}
+SOCK=${TMPDIR:-/tmp}/mind-loadtest.$$
+
+now() { date +%s%N; }
+
+# Read latencies in nanoseconds and print their percentiles
+percentiles() {
+    sort -n | awk -v label="$1" '
+	{ t[NR] = $1 }
+	function p(q) { return t[int((NR - 1) * q) + 1] / 1000 }
+	END { printf "%-8s n=%d  p50=%.0f  p90=%.0f  p99=%.0f  max=%.0f us\n",
+		     label, NR, p(0.5), p(0.9), p(0.99), t[NR] / 1000 }'
+}
+
+run() {
+    i=0
+    while [ $i -lt $N ]; do
+	t=$(now)
+	"$@" >/dev/null
+	echo $(($(now) - t))
+	i=$((i + 1))
+    done
+}
+
+run $MIND -e "$CMD" | percentiles "-e"
+
+$MIND -S $SOCK &
+server=$!
+while [ ! -S $SOCK ]; do sleep 0.01; done
+run $MIND -C $SOCK -e "$CMD" | percentiles "-S/-C"
+kill $server
+rm -f $SOCK
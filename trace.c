@@ -0,0 +1,68 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the execution trace: a ring buffer with the last
+// TRACE_SIZE words that the inner interpreter executed. If the kernel
+// is compiled with TRACE, it is written by the `trace` routine, through
+// which the kernel words are routed while tracing is on, and by the
+// runtimes like `docol`; `next` itself is unchanged. It is printed on
+// `abort`, with `trace-dump` or when the process gets SIGUSR1.
+
+#include "trace.h"
+
+volatile sig_atomic_t trace_flags;
+trace_entry_t trace_buffer[TRACE_SIZE];
+ucell trace_pos;
+cell trace_clock;
+
+// Name of the word *xt*, or NULL if it is not a word
+static char *trace_name(trace_env_t *env, cell xt)
+{
+    cell e = (cell)FROM_XT(xt);
+
+    if (xt % sizeof(cell))
+	return NULL;
+    if (xt >= (cell)env->dict && xt < (cell)(env->dict + env->num_words))
+	return (char*)FROM_XT(xt)->name;
+    if (e >= env->mem && xt < env->here)
+	return (char*)FROM_XT(xt)->name;
+    return NULL;
+}
+
+// Print the trace, oldest entry first. Times are relative to the
+// newest entry.
+void trace_dump(FILE *out, trace_env_t *env)
+{
+    ucell end = trace_pos;
+    ucell i = end > TRACE_SIZE ? end - TRACE_SIZE : 0;
+    cell now = end ? trace_buffer[(end - 1) & (TRACE_SIZE - 1)].time : 0;
+
+    fprintf(out, "Trace: %"PRIdCELL" words\n", (cell)(end - i));
+    for (; i < end; i++) {
+	trace_entry_t *t = &trace_buffer[i & (TRACE_SIZE - 1)];
+	char *name = trace_name(env, t->xt);
+
+	fprintf(out, "%12"PRIdCELL" %16"PRIxCELL" %4"PRIdCELL" ",
+		t->time - now, t->ip, t->depth);
+	if (name)
+	    fprintf(out, "%s\n", name);
+	else
+	    fprintf(out, "?%"PRIxCELL"\n", t->xt);
+    }
+    fflush(out);
+}
+
+static void trace_signal(int sig)
+{
+    (void)sig;
+    trace_flags |= TRACE_DUMP;
+}
+
+void trace_init(void)
+{
+    signal(SIGUSR1, trace_signal);
+}
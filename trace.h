@@ -0,0 +1,76 @@
+// mind -- a Forth interpreter
+// Copyright 2011-2014 Markus Redeker <cep@ibp.de>
+//
+// Published under the GNU General Public License version 2 or any
+// later version, at your choice. There is NO WARRANY, not at all. See
+// the file "copying" for details.
+
+// This file contains the execution trace. It is only active if the
+// program is compiled with TRACE defined.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <signal.h>
+#include <time.h>
+
+#include "dict.h"
+
+#define TRACE_SIZE  0x1000      // Number of entries, a power of 2
+#define TRACE_CLOCK 0x40        // Entries between two reads of the clock
+
+// Bits of `trace_flags`
+#define TRACE_ON    1           // Record the executed words
+#define TRACE_DUMP  2           // Dump the trace at the next word
+
+typedef struct {
+    cell xt;                    // Word that was executed
+    cell ip;                    // (cell*) Address of the call
+    cell depth;                 // Depth of the parameter stack
+    cell time;                  // Time stamp
+} trace_entry_t;
+
+extern volatile sig_atomic_t trace_flags;
+extern trace_entry_t trace_buffer[TRACE_SIZE];
+extern ucell trace_pos;         // Number of recorded entries
+extern cell trace_clock;        // Time stamp of the newest entries
+
+// Time stamp: the processor cycle counter, where there is one.
+static inline cell trace_time(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (cell)__builtin_ia32_rdtsc();
+#else
+    return (cell)clock();
+#endif
+}
+
+// Record one entry. There is only one writer, and a reader only needs
+// `trace_pos`, so there is no lock. Reading the clock is slow, so
+// it is done only for every TRACE_CLOCK-th entry.
+static inline void trace_record(cell xt, cell ip, cell depth)
+{
+    trace_entry_t *t = &trace_buffer[trace_pos & (TRACE_SIZE - 1)];
+
+    if (!(trace_pos & (TRACE_CLOCK - 1)))
+	trace_clock = trace_time();
+    t->xt = xt;
+    t->ip = ip;
+    t->depth = depth;
+    t->time = trace_clock;
+    trace_pos++;
+}
+
+// The range of memory where dictionary entries can be found
+typedef struct {
+    entry_t *dict;              // Kernel dictionary
+    cell num_words;             // Number of entries in `dict`
+    cell mem;                   // Start of the main memory
+    cell here;                  // End of the dictionary
+} trace_env_t;
+
+void trace_dump(FILE *out, trace_env_t *env);
+void trace_init(void);
+
+#endif